@@ -0,0 +1,150 @@
+/*
+ * Config.c
+ *	EEPROM configuration records. Loading reads every slot once at startup and
+ *  keeps the newest valid record. Saving never blocks: the record is copied
+ *  and the EE_READY interrupt writes it one byte per EEPROM write cycle
+ *  (about 3.4ms), skipping bytes that already hold the right value. The CRC is
+ *  the last field written, so a record is only valid once it is complete.
+ *
+ *  While a save is in progress the interrupt owns EEAR and EEDR; blocking
+ *  eeprom_* callers must wait for config_busy() to clear first.
+ *
+ * Created: 10/19/2026
+ */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/eeprom.h>
+#include <util/atomic.h>
+#include <util/crc16.h>
+#include <stddef.h>
+
+#include "Config.h"
+
+typedef struct {
+	uint8_t version;		// CONFIG_VERSION
+	uint8_t seq;			// save counter; the newest record has the highest (mod 256)
+	CONFIG config;
+	uint16_t crc;			// CRC16 of everything above
+} CONFIG_RECORD;
+
+CONFIG_RECORD EEMEM config_slots[CONFIG_SLOTS];
+
+static CONFIG_RECORD record;				// record being written by the ISR
+static CONFIG pending_config;				// newest settings saved during a write
+static volatile uint8_t pending = 0;
+static volatile uint8_t writing = 0;
+static volatile uint8_t write_pos;			// next byte of record to write
+static uint8_t slot = CONFIG_SLOTS - 1;		// slot of the newest record
+static uint8_t seq = 0;
+
+static uint16_t config_crc(const CONFIG_RECORD *r)
+{
+	const uint8_t *data = (const uint8_t *) r;
+	uint16_t crc = 0xFFFF;
+
+	for (uint8_t i = 0; i < offsetof(CONFIG_RECORD, crc); i++)
+	{
+		crc = _crc_ccitt_update(crc, data[i]);
+	}
+	return crc;
+}
+
+/*
+ * Queues c as the next record and lets the ISR start writing it.
+ * Called with interrupts off.
+ */
+static void config_start(const CONFIG *c)
+{
+	slot = (slot + 1) % CONFIG_SLOTS;
+	record.version = CONFIG_VERSION;
+	record.seq = ++seq;
+	record.config = *c;
+	record.crc = config_crc(&record);
+	write_pos = 0;
+	writing = 1;
+	EECR |= (1 << EERIE);
+}
+
+/*
+ * Writes the next byte of the record each time the EEPROM is ready,
+ * then moves on to a save that arrived meanwhile, or goes idle.
+ */
+ISR(EE_READY_vect)
+{
+	if (write_pos < sizeof(record)) {
+		uint8_t data = ((uint8_t *) &record)[write_pos];
+
+		EEAR = (uint16_t) ((uint8_t *) &config_slots[slot] + write_pos);
+		write_pos++;
+		EECR |= (1 << EERE);
+		if (EEDR != data) {
+			//erase and write; EEPE must follow EEMPE within four cycles
+			EEDR = data;
+			EECR |= (1 << EEMPE);
+			EECR |= (1 << EEPE);
+		}
+	} else if (pending) {
+		pending = 0;
+		config_start(&pending_config);
+	} else {
+		writing = 0;
+		EECR &= ~(1 << EERIE);
+	}
+}
+
+/*
+ * Reads the newest valid record. Call at startup, before anything else uses
+ * the EEPROM; it takes well under a millisecond.
+ *
+ * @param CONFIG * c - filled in with the saved settings if there are any
+ * @return uint8_t - 1 if a valid record was found, 0 if c was left untouched
+ */
+uint8_t config_load(CONFIG *c)
+{
+	CONFIG_RECORD r;
+	uint8_t found = 0;
+
+	for (uint8_t i = 0; i < CONFIG_SLOTS; i++)
+	{
+		eeprom_read_block(&r, &config_slots[i], sizeof(r));
+		if (r.version != CONFIG_VERSION || config_crc(&r) != r.crc) {
+			continue;
+		}
+		//the slots hold consecutive counters, so the signed difference orders them across a wrap
+		if (!found || (int8_t) (r.seq - seq) > 0) {
+			found = 1;
+			seq = r.seq;
+			slot = i;
+			*c = r.config;
+		}
+	}
+	return found;
+}
+
+/*
+ * Saves the settings in the background. A save made while another is still
+ * being written replaces any save queued behind it, so only the newest
+ * settings are written next.
+ *
+ * @param const CONFIG * c - settings to save
+ */
+void config_save(const CONFIG *c)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		if (writing) {
+			pending_config = *c;
+			pending = 1;
+		} else {
+			config_start(c);
+		}
+	}
+}
+
+/*
+ * @return uint8_t - 1 while a save is being written
+ */
+uint8_t config_busy(void)
+{
+	return writing;
+}
@@ -0,0 +1,55 @@
+/*
+ * Config.h
+ *	Operator settings kept in EEPROM so a reset or brownout does not leave the
+ *  box unconfigured. Each save writes a versioned, CRC-protected record to the
+ *  next of CONFIG_SLOTS slots in turn, so the cells wear evenly and a save cut
+ *  short by a power loss leaves the previous record intact.
+ *
+ * Created: 10/19/2026
+ */
+
+
+#ifndef CONFIG_H_
+#define CONFIG_H_
+
+#include <stdint.h>
+
+#include "System.h"
+
+#define CONFIG_VERSION		4		// bump whenever CONFIG changes layout or meaning
+#define CONFIG_SLOTS		8		// records rotated through; each is written 1/8 as often
+
+/*
+ * The saved settings of one zone
+ */
+typedef struct {
+	int16_t target_temp;	// 1/16 degree Celsius
+	int16_t over_temp;		// 1/16 degree Celsius
+	uint16_t timeout;		// seconds
+	uint8_t rom[8];			// ROM ID of the zone's sensor; all zero for sensor table entry <zone>
+} CONFIG_ZONE;
+
+/*
+ * The saved settings
+ */
+typedef struct {
+	CONFIG_ZONE zone[ZONE_COUNT];
+	uint16_t sample_rate;	// milliseconds
+	uint16_t report_rate;	// milliseconds
+	char display_format;	// 'C', 'F' or 'X'
+	uint8_t resolution;		// sensor resolution, 9-12 bits
+	int16_t kp;				// PID gains
+	int16_t ki;
+	int16_t kd;
+	uint8_t filter_median;	// median window, samples
+	uint16_t filter_alpha;	// EMA weight, 1/256
+} CONFIG;
+
+//
+// Function Prototypes
+//
+uint8_t config_load(CONFIG *);
+void config_save(const CONFIG *);
+uint8_t config_busy(void);
+
+#endif /* CONFIG_H_ */
@@ -0,0 +1,49 @@
+/*
+ * Control.c
+ *	Control law of one thermal zone. Positive PID output heats with the lamps
+ *  over a base fan flow; negative output cools by raising the fan above it.
+ *  The EMA smooths what the PID sees; the over-temperature check also looks
+ *  at the median, which rejects spikes but does not lag a real rise.
+ *
+ * Created: 10/19/2026
+ */
+
+#include "Control.h"
+#include "Pwm.h"
+
+/*
+ * Acts on one raw reading of a zone's sensor.
+ *
+ * @param ZONE * z - the zone's control state
+ * @param uint8_t zone - the zone (PWM channel)
+ * @param uint8_t mode - CONTROL_OFF, CONTROL_MONITOR or CONTROL_RUN
+ * @param int16_t raw - the reading, 1/16 degree Celsius
+ * @param int16_t target - target temperature, 1/16 degree Celsius
+ * @param int16_t over_temp - over-temperature limit, 1/16 degree Celsius
+ * @param int16_t * temp - receives the filtered temperature
+ * @param int16_t * output - receives the PID output, permille (0 unless running)
+ * @return uint8_t - CONTROL_OVER_TEMP if the median or the filtered temperature reached the limit, else CONTROL_OK
+ */
+uint8_t control_update(ZONE *z, uint8_t zone, uint8_t mode, int16_t raw, int16_t target, int16_t over_temp, int16_t *temp, int16_t *output)
+{
+	*temp = filter_update(&z->filter, raw);
+	*output = 0;
+
+	if (mode == CONTROL_OFF) {
+		return CONTROL_OK;
+	}
+	if (*temp >= over_temp || filter_median(&z->filter) >= over_temp) {
+		return CONTROL_OVER_TEMP;
+	}
+	if (mode == CONTROL_RUN) {
+		*output = pid_update(&z->pid, target, *temp);
+		if (*output > 0) {
+			pwm_set_heater(zone, *output);
+			pwm_set_fan(zone, PWM_FAN_DEFAULT);
+		} else {
+			pwm_set_heater(zone, 0);
+			pwm_set_fan(zone, PWM_FAN_DEFAULT + (uint32_t) (-*output) * (PWM_MAX - PWM_FAN_DEFAULT) / PID_OUTPUT_MAX);
+		}
+	}
+	return CONTROL_OK;
+}
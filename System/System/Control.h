@@ -0,0 +1,47 @@
+/*
+ * Control.h
+ *	The control law of one thermal zone: filter the sensor reading, check it
+ *  against the over-temperature limit and drive the zone's heater and fan
+ *  from the PID. The outputs are reached only through the Pwm.h functions,
+ *  so the host simulator (Tools/thermal_sim.c) can link this same code
+ *  against a simulated plant.
+ *
+ * Created: 10/19/2026
+ */
+
+
+#ifndef CONTROL_H_
+#define CONTROL_H_
+
+#include <stdint.h>
+
+#include "Pid.h"
+#include "Filter.h"
+
+/*
+ * What control_update may do with a zone
+ */
+#define CONTROL_OFF			0	// filter only: the zone is shut down
+#define CONTROL_MONITOR		1	// filter and check the limit: service mode
+#define CONTROL_RUN			2	// filter, check the limit and drive the outputs
+
+/*
+ * control_update results
+ */
+#define CONTROL_OK			0
+#define CONTROL_OVER_TEMP	1	// median or filtered temperature at or above the limit; the outputs were left alone
+
+/*
+ * The control state of one zone
+ */
+typedef struct {
+	PID pid;				// drives the zone's heater and fan
+	FILTER filter;			// spike rejection and smoothing of the zone's sensor
+} ZONE;
+
+//
+// Function Prototypes
+//
+uint8_t control_update(ZONE *, uint8_t, uint8_t, int16_t, int16_t, int16_t, int16_t *, int16_t *);
+
+#endif /* CONTROL_H_ */
@@ -5,58 +5,403 @@
  *  Author: waldonck
  */ 
 #include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/eeprom.h>
+#include <avr/pgmspace.h>
+#include <util/atomic.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include "System.h"
+#include "acx.h"
+#include "Delay.h"
 #include "DS18B20.h"
-#include "serial.h"
+
+/*
+ * Table of the sensors found on the bus and their latest readings
+ */
+OW_SENSOR ow_sensors[OW_MAX_SENSORS];
+unsigned char ow_sensor_count = 0;
+
+/*
+ * ROM IDs cached in EEPROM so a restart need not search the bus
+ */
+uint8_t EEMEM ow_ee_count = 0xFF;
+uint8_t EEMEM ow_ee_roms[OW_MAX_SENSORS][8];
+
+/*
+ * Scratchpad CRC checking. With it off, reads stop after the two
+ * temperature bytes and a reset ends the transfer.
+ */
+unsigned char ow_check_crc = 1;
+unsigned char ow_resolution = 12;
+OW_ERRORS ow_errors;
+
+/*
+ * Dallas/Maxim CRC8 (x^8 + x^5 + x^4 + 1, reflected) of every byte value
+ */
+static const uint8_t ow_crc8_table[256] PROGMEM = {
+	0x00, 0x5E, 0xBC, 0xE2, 0x61, 0x3F, 0xDD, 0x83, 0xC2, 0x9C, 0x7E, 0x20, 0xA3, 0xFD, 0x1F, 0x41,
+	0x9D, 0xC3, 0x21, 0x7F, 0xFC, 0xA2, 0x40, 0x1E, 0x5F, 0x01, 0xE3, 0xBD, 0x3E, 0x60, 0x82, 0xDC,
+	0x23, 0x7D, 0x9F, 0xC1, 0x42, 0x1C, 0xFE, 0xA0, 0xE1, 0xBF, 0x5D, 0x03, 0x80, 0xDE, 0x3C, 0x62,
+	0xBE, 0xE0, 0x02, 0x5C, 0xDF, 0x81, 0x63, 0x3D, 0x7C, 0x22, 0xC0, 0x9E, 0x1D, 0x43, 0xA1, 0xFF,
+	0x46, 0x18, 0xFA, 0xA4, 0x27, 0x79, 0x9B, 0xC5, 0x84, 0xDA, 0x38, 0x66, 0xE5, 0xBB, 0x59, 0x07,
+	0xDB, 0x85, 0x67, 0x39, 0xBA, 0xE4, 0x06, 0x58, 0x19, 0x47, 0xA5, 0xFB, 0x78, 0x26, 0xC4, 0x9A,
+	0x65, 0x3B, 0xD9, 0x87, 0x04, 0x5A, 0xB8, 0xE6, 0xA7, 0xF9, 0x1B, 0x45, 0xC6, 0x98, 0x7A, 0x24,
+	0xF8, 0xA6, 0x44, 0x1A, 0x99, 0xC7, 0x25, 0x7B, 0x3A, 0x64, 0x86, 0xD8, 0x5B, 0x05, 0xE7, 0xB9,
+	0x8C, 0xD2, 0x30, 0x6E, 0xED, 0xB3, 0x51, 0x0F, 0x4E, 0x10, 0xF2, 0xAC, 0x2F, 0x71, 0x93, 0xCD,
+	0x11, 0x4F, 0xAD, 0xF3, 0x70, 0x2E, 0xCC, 0x92, 0xD3, 0x8D, 0x6F, 0x31, 0xB2, 0xEC, 0x0E, 0x50,
+	0xAF, 0xF1, 0x13, 0x4D, 0xCE, 0x90, 0x72, 0x2C, 0x6D, 0x33, 0xD1, 0x8F, 0x0C, 0x52, 0xB0, 0xEE,
+	0x32, 0x6C, 0x8E, 0xD0, 0x53, 0x0D, 0xEF, 0xB1, 0xF0, 0xAE, 0x4C, 0x12, 0x91, 0xCF, 0x2D, 0x73,
+	0xCA, 0x94, 0x76, 0x28, 0xAB, 0xF5, 0x17, 0x49, 0x08, 0x56, 0xB4, 0xEA, 0x69, 0x37, 0xD5, 0x8B,
+	0x57, 0x09, 0xEB, 0xB5, 0x36, 0x68, 0x8A, 0xD4, 0x95, 0xCB, 0x29, 0x77, 0xF4, 0xAA, 0x48, 0x16,
+	0xE9, 0xB7, 0x55, 0x0B, 0x88, 0xD6, 0x34, 0x6A, 0x2B, 0x75, 0x97, 0xC9, 0x4A, 0x14, 0xF6, 0xA8,
+	0x74, 0x2A, 0xC8, 0x96, 0x15, 0x4B, 0xA9, 0xF7, 0xB6, 0xE8, 0x0A, 0x54, 0xD7, 0x89, 0x6B, 0x35
+};
+
+/*
+ * Search ROM state carried between ow_search calls
+ */
+static unsigned char ow_last_discrepancy;
+static unsigned char ow_last_device;
+
+/*
+ * State of the transfer in progress. Both backends run a transfer from their
+ * ISR, one bit slot at a time, while the calling thread sleeps in ACX.
+ */
+static volatile uint8_t ow_tx_bits;		// bits still to send, LSB first
+static volatile uint8_t ow_rx_bits;		// bits read back, shifted in from the top
+static volatile uint8_t ow_slots;		// slots left in the transfer; 0 for a reset
+static volatile uint8_t ow_busy;
+static volatile byte ow_waiters;		// threads sleeping until the transfer is done
+
+/*
+ * Ends the transfer and wakes the thread waiting on it. Called from the ISRs.
+ */
+static inline void ow_done(void)
+{
+	ow_busy = 0;
+	if (ow_waiters) {
+		x_resume_mask(ow_waiters);
+		ow_waiters = 0;
+	}
+}
+
+/*
+ * Sleeps until the ISR has finished the transfer in progress.
+ */
+static void ow_wait(void)
+{
+	while (ow_busy) {
+		char parked = 0;
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+			if (ow_busy) {
+				ow_waiters |= x_thread_mask;
+				x_suspend(x_getTID());
+				parked = 1;
+			}
+		}
+		if (parked) {
+			x_yield();
+		}
+	}
+}
+
+#if OW_USE_USART1
+/*
+ * USART1 1-Wire master. Every bus slot is one USART frame: a reset is 0xF0
+ * sent at 9600 baud (the sensors' presence pulse corrupts the echo), a bit slot
+ * is 0xFF (write 1 / read) or 0x00 (write 0) sent at 115200 baud, and the echo
+ * of 0xFF reads back 0xFF only if no sensor held the bus low. The RX ISR starts
+ * each slot of a byte as the previous one completes.
+ */
+#define OW_UBRR(baud)	((F_CPU + 4 * (baud)) / (8 * (baud)) - 1)	// U2X1 set
+#define OW_RESET_BAUD	9600UL
+#define OW_SLOT_BAUD	115200UL
+
+/*
+ * Check the frames against the DS18B20 timing windows at the baud rates the
+ * UBRR values really give at this F_CPU. Bits go out LSB first after a low
+ * start bit, and the receiver samples mid-bit.
+ */
+#define OW_BIT_NS(baud)	(8ULL * (OW_UBRR(baud) + 1) * 1000000000ULL / F_CPU)
+#if 5 * OW_BIT_NS(OW_RESET_BAUD) < 480000
+#error "1-Wire reset pulse (start bit + 4 zeros of 0xF0) or time slot after it shorter than 480us"
+#endif
+#if 9 * OW_BIT_NS(OW_SLOT_BAUD) < 60000 || 9 * OW_BIT_NS(OW_SLOT_BAUD) > 120000
+#error "1-Wire write-0 low time (start bit + 8 zeros) outside 60-120us"
+#endif
+#if 3 * OW_BIT_NS(OW_SLOT_BAUD) / 2 >= 15000
+#error "1-Wire read sample point (middle of bit 0) not within 15us"
+#endif
+
+/*
+ * A frame whose echo has not come back within OW_TIMEOUT_US (a reset frame
+ * takes about 1ms) means a broken bus or USART wiring. TIMER3, unused by this
+ * backend, times every frame and abandons the transfer when it runs out.
+ */
+#define OW_TIMEOUT_US		5000
+#define OW_TIMEOUT_TICKS	((uint16_t) ((F_CPU / 64) * OW_TIMEOUT_US / 1000000UL))	// TIMER3 at clkIO/64
+
+static uint8_t ow_usart_ready = 0;
+
+/*
+ * Restarts the echo timeout for the frame just sent.
+ */
+static inline void ow_timeout_start(void)
+{
+	OCR3A = TCNT3 + OW_TIMEOUT_TICKS;
+	TIFR3 = (1 << OCF3A);
+	TIMSK3 |= (1 << OCIE3A);
+}
+
+ISR(USART1_RX_vect)
+{
+	uint8_t echo = UDR1;
+	if (ow_slots == 0) {
+		ow_rx_bits = (echo != 0xF0); //reset: presence if the echo was corrupted
+	} else {
+		ow_rx_bits = (ow_rx_bits >> 1) | ((echo == 0xFF) ? 0x80 : 0);
+		if (--ow_slots) {
+			ow_tx_bits >>= 1;
+			UDR1 = (ow_tx_bits & 0x01) ? 0xFF : 0x00;
+			ow_timeout_start();
+			return;
+		}
+	}
+	TIMSK3 &= ~(1 << OCIE3A);
+	ow_done();
+}
+
+ISR(TIMER3_COMPA_vect)
+{
+	//no echo: turn the USART off so a late one cannot leak into the next transfer
+	TIMSK3 &= ~(1 << OCIE3A);
+	UCSR1B = 0;
+	ow_usart_ready = 0;
+	ow_rx_bits = 0;
+	ow_slots = 0;
+	ow_errors.timeouts++;
+	ow_done();
+}
 
 /************************************************************************/
-/* Attempts to determine whether there is a sensor attached.            */
+/* Run one transfer of slots bit slots (0 for a reset pulse) and sleep  */
+/* until the RX ISR has finished it. Returns the bits read back,        */
+/* right-aligned, or 1 if a reset saw a presence pulse. A transfer      */
+/* whose echo times out reads back as 0 (no presence, all zero bits).   */
 /************************************************************************/
-unsigned char ow_reset(void)
+static uint8_t ow_transfer(uint8_t bits, uint8_t slots)
 {
-	unsigned char presence;
-	
- // pull DQ line low
-	DDRE |= (1 << PE4); //set for output
-	PORTE &= ~(1 << PE4); //set value low
+	if (!ow_usart_ready) {
+		UCSR1A = (1 << U2X1);
+		UBRR1 = OW_UBRR(OW_SLOT_BAUD);
+		UCSR1C = (1 << UCSZ11) | (1 << UCSZ10); //8N1
+		UCSR1B = (1 << RXEN1) | (1 << TXEN1) | (1 << RXCIE1);
+		TCCR3A = 0;
+		TCCR3B = (1 << CS31) | (1 << CS30); //normal mode, clkIO/64, for the echo timeout
+		ow_usart_ready = 1;
+	}
+	if (slots == 0) {
+		UBRR1 = OW_UBRR(OW_RESET_BAUD);
+	}
+	ow_tx_bits = bits;
+	ow_rx_bits = 0;
+	ow_slots = slots;
+	ow_busy = 1;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		UDR1 = (slots == 0) ? 0xF0 : ((bits & 0x01) ? 0xFF : 0x00);
+		ow_timeout_start();
+	}
+	ow_wait();
 
- // leave it low for 480us
-	delay_usec(479);
+	if (slots == 0) {
+		UBRR1 = OW_UBRR(OW_SLOT_BAUD); //the echo is in, so the reset frame is done
+		return ow_rx_bits;
+	}
+	return ow_rx_bits >> (8 - slots);
+}
+
+#else
+/*
+ * PE4 bit-bang master scheduled by TIMER3. The compare A ISR starts every
+ * slot at a precomputed time and only busy-waits through the part that must
+ * be exact to the microsecond: the short low pulse of a write-1 or read slot
+ * and the sample point 12us after it. A write-0 low pulse and the recovery
+ * between slots are timed by the next compare match, so the CPU is free (and
+ * other interrupts may run) for most of each 65us slot.
+ */
+#define OW_TICKS(us)	((uint16_t) ((F_CPU / 8) * (us) / 1000000UL))	// TIMER3 at clkIO/8
+
+#define OW_T_RESET_US		480		// reset low time
+#define OW_T_PRESENCE_US	70		// release to presence sample
+#define OW_T_RESET_END_US	410		// presence sample to end of reset
+#define OW_T_LOW_US			2		// low pulse of a write-1 or read slot
+#define OW_T_SAMPLE_US		10		// release to sample point (12us into the slot)
+#define OW_T_SLOT_US		60		// slot length (write-0 low time)
+#define OW_T_RECOVERY_US	5		// bus recovery between slots
+
+/*
+ * Check the slot timing against the DS18B20 windows
+ */
+#if F_CPU / 8 < 1000000
+#error "TIMER3 too slow for 1-Wire slot timing; F_CPU must be 8 MHz or more"
+#endif
+#if OW_T_RESET_US < 480 || OW_T_PRESENCE_US + OW_T_RESET_END_US < 480
+#error "1-Wire reset pulse or reset time slot shorter than 480us"
+#endif
+#if OW_T_PRESENCE_US < 60 || OW_T_PRESENCE_US > 75
+#error "1-Wire presence sample must fall 60-75us after release"
+#endif
+#if OW_T_LOW_US < 1 || OW_T_LOW_US + OW_T_SAMPLE_US >= 15
+#error "1-Wire read/write-1 slot must sample within 15us of going low"
+#endif
+#if OW_T_SLOT_US < 60 || OW_T_SLOT_US > 120 || OW_T_RECOVERY_US < 1
+#error "1-Wire slot outside 60-120us or no recovery time"
+#endif
+
+#define OW_LOW()		(DDRE |= (1 << PE4))	// PORTE4 stays 0, so driving the pin pulls the bus low
+#define OW_RELEASE()	(DDRE &= ~(1 << PE4))	// the pull-up returns the bus high
+
+enum {
+	OW_PHASE_SLOT,			// start the next bit slot
+	OW_PHASE_WRITE0_END,	// end a write-0 low pulse
+	OW_PHASE_RESET,			// end the reset pulse
+	OW_PHASE_PRESENCE,		// sample the presence pulse
+	OW_PHASE_RESET_END,		// reset time slot over
+	OW_PHASE_END			// last slot and its recovery over
+};
+
+static volatile uint8_t ow_phase;
+static uint16_t ow_slot_start;			// TIMER3 count at which the bus last went low (or was released)
+
+/*
+ * Sets the next compare match ticks after the given time. A match that is
+ * already due (the ISR was held off) is moved just ahead of the counter, so
+ * it is never missed for a whole timer period.
+ */
+static inline void ow_schedule(uint16_t from, uint16_t ticks)
+{
+	uint16_t at = from + ticks;
+	if ((int16_t) (at - TCNT3) < (int16_t) OW_TICKS(2)) {
+		at = TCNT3 + OW_TICKS(2);
+	}
+	OCR3A = at;
+}
+
+/*
+ * Ends a bit slot: starts the next one after the recovery time, or ends the
+ * transfer then. A read slot is sampled 12us in, but the sensor may hold the
+ * bus to the end of the slot, so the next transfer must not start before it.
+ */
+static inline void ow_slot_done(void)
+{
+	if (--ow_slots) {
+		ow_tx_bits >>= 1;
+		ow_phase = OW_PHASE_SLOT;
+	} else {
+		ow_phase = OW_PHASE_END;
+	}
+	ow_schedule(ow_slot_start, OW_TICKS(OW_T_SLOT_US + OW_T_RECOVERY_US));
+}
+
+ISR(TIMER3_COMPA_vect)
+{
+	switch (ow_phase) {
+		case OW_PHASE_SLOT:
+			//time everything from the actual edge, so a late ISR never shortens a pulse
+			ow_slot_start = TCNT3;
+			OW_LOW();
+			if (ow_tx_bits & 0x01) {
+				//write 1 or read: release quickly, then sample what the sensor drives
+				delay_us(OW_T_LOW_US);
+				OW_RELEASE();
+				delay_us(OW_T_SAMPLE_US);
+				ow_rx_bits = (ow_rx_bits >> 1) | ((PINE & (1 << PE4)) ? 0x80 : 0);
+				ow_slot_done();
+			} else {
+				ow_rx_bits >>= 1;
+				ow_phase = OW_PHASE_WRITE0_END;
+				ow_schedule(ow_slot_start, OW_TICKS(OW_T_SLOT_US));
+			}
+			break;
+
+		case OW_PHASE_WRITE0_END:
+			OW_RELEASE();
+			ow_slot_done();
+			break;
+
+		case OW_PHASE_RESET:
+			OW_RELEASE();
+			ow_slot_start = TCNT3;
+			ow_phase = OW_PHASE_PRESENCE;
+			ow_schedule(ow_slot_start, OW_TICKS(OW_T_PRESENCE_US));
+			break;
+
+		case OW_PHASE_PRESENCE:
+			ow_rx_bits = !(PINE & (1 << PE4)); //a sensor holds the bus low
+			ow_phase = OW_PHASE_RESET_END;
+			ow_schedule(ow_slot_start, OW_TICKS(OW_T_PRESENCE_US + OW_T_RESET_END_US));
+			break;
 
- // allow line to return high
-	PORTE |= (1 << PE4); //set value high
-	DDRE &= ~(1 << PE4); //set for input
-	//PORTE &= ~(1 << PE4); //set value low?
+		case OW_PHASE_RESET_END:
+		case OW_PHASE_END:
+			TIMSK3 &= ~(1 << OCIE3A);
+			ow_done();
+			break;
+	}
+}
 
- // wait for presence
-	delay_usec(69);
+/************************************************************************/
+/* Run one transfer of slots bit slots (0 for a reset pulse) and sleep  */
+/* until the TIMER3 ISR has finished it. Returns the bits read back,    */
+/* right-aligned, or 1 if a reset saw a presence pulse.                 */
+/************************************************************************/
+static uint8_t ow_transfer(uint8_t bits, uint8_t slots)
+{
+	PORTE &= ~(1 << PE4); //no internal pull-up; the pin only ever drives low
+	TCCR3A = 0;
+	TCCR3B = (1 << CS31); //normal mode, clkIO/8
+	ow_tx_bits = bits;
+	ow_rx_bits = 0;
+	ow_slots = slots;
+	ow_busy = 1;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		if (slots == 0) {
+			OW_LOW();
+			ow_phase = OW_PHASE_RESET;
+			OCR3A = TCNT3 + OW_TICKS(OW_T_RESET_US);
+		} else {
+			ow_phase = OW_PHASE_SLOT;
+			OCR3A = TCNT3 + OW_TICKS(2);
+		}
+		TIFR3 = (1 << OCF3A);
+		TIMSK3 |= (1 << OCIE3A);
+	}
+	ow_wait();
 
- // get presence signal
-	presence = !(PINE & (1 << PE4)); //read for presence
+	if (slots == 0) {
+		return ow_rx_bits;
+	}
+	return ow_rx_bits >> (8 - slots);
+}
 
-// wait for end of timeslot
-	delay_usec(229); 
+#endif /* OW_USE_USART1 */
 
-	return(presence); // presence signal returned
-} // 1=presence, 0=no sensor
+/************************************************************************/
+/* Attempts to determine whether there is a sensor attached.            */
+/************************************************************************/
+unsigned char ow_reset(void)
+{
+	return ow_transfer(0, 0); // 1=presence, 0=no sensor
+}
 
 /************************************************************************/
 /* Read a single bit from the sensor                                    */
 /************************************************************************/
 unsigned char ow_read_bit(void)
 {
-	//pull low
-	DDRE |= (1 << PE4);
-	PORTE &= ~(1 << PE4);
-	//let return to high
-	PORTE |= (1 << PE4); //set value high
-	DDRE &= ~(1 << PE4); //set for input
-	
-	delay_usec(14); //wait 15us
-	
-	return(PINE & (1 << PE4));
+	return ow_transfer(0x01, 1);
 }
 
 /************************************************************************/
@@ -64,34 +409,15 @@ unsigned char ow_read_bit(void)
 /************************************************************************/
 void ow_write_bit(char bitval)
 {
-	//pull low
-	DDRE |= (1 << PE4);
-	PORTE &= ~(1 << PE4);
-	
-	//if writing a one, go high
-	if (bitval == 1) {
-		PORTE |= (1 << PE4); //set value high
-	}
-	delay_usec(59); //wait 60us
-	
-	PORTE |= (1 << PE4); //set value high
-	DDRE &= ~(1 << PE4); //set for input
+	ow_transfer(bitval == 1, 1);
 }
 
 /************************************************************************/
 /* Read a single byte from the sensor                                   */
 /************************************************************************/
-unsigned char ow_read_byte(void) 
+unsigned char ow_read_byte(void)
 {
-	unsigned char value = 0;
-	unsigned char i;
-	for (i = 0; i < 8; i++) {
-		if (ow_read_bit()) {
-			value |= 0x01 << i; //reads a bit and left-shifts it into place
-		}
-		delay_usec(19); //wait 20us
-	}
-	return value;
+	return ow_transfer(0xFF, 8);
 }
 
 /************************************************************************/
@@ -99,43 +425,304 @@ unsigned char ow_read_byte(void)
 /************************************************************************/
 void ow_write_byte(char val)
 {
-	unsigned char i;
-	unsigned char temp;
-	for (i = 0; i < 8; i++) {
-		temp = val >> i;
-		temp &= 0x01;
-		ow_write_bit(temp);
-	}
-	delay_usec(119); //wait 120us
+	ow_transfer(val, 8);
 }
 
 /************************************************************************/
-/* Read the current temperature from the sensor                         */
+/* Start a temperature conversion on the sensor. Returns immediately;   */
+/* the result is ready after ow_conversion_ms (or ow_conversion_done).  */
 /************************************************************************/
-int ow_read_temperature(void)
+unsigned char ow_start_conversion(void)
 {
-	char get[10];
-	char temp_lsb,temp_msb;
-	int k;
-	char temp_c;
-	char shift_val = 4;
-	ow_reset();
+	if (!ow_reset()) {
+		return 0; //no sensor answered
+	}
 	ow_write_byte(0xCC); //Skip ROM
 	ow_write_byte(0x44); // Start Conversion
-	delay_usec(119); //wait 120us
-	ow_reset();
+	return 1;
+}
+
+/************************************************************************/
+/* Worst-case conversion time at the current resolution; it halves      */
+/* with every bit dropped (750, 375, 188 and 94ms).                     */
+/************************************************************************/
+unsigned int ow_conversion_ms(void)
+{
+	unsigned char shift = 12 - ow_resolution;
+	return (OW_CONVERSION_MS + (1 << shift) - 1) >> shift;
+}
+
+/************************************************************************/
+/* Set the resolution (9-12 bits) of every sensor on the bus with       */
+/* Write Scratchpad. Returns 0 if no sensor answered or bits is out     */
+/* of range.                                                            */
+/************************************************************************/
+unsigned char ow_set_resolution(unsigned char bits)
+{
+	if (bits < 9 || bits > 12 || !ow_reset()) {
+		return 0;
+	}
 	ow_write_byte(0xCC); // Skip ROM
+	ow_write_byte(0x4E); // Write Scratch Pad
+	ow_write_byte(OW_ALARM_HIGH);
+	ow_write_byte(OW_ALARM_LOW);
+	ow_write_byte(((bits - 9) << 5) | 0x1F); // configuration register
+	ow_resolution = bits;
+	return 1;
+}
+
+/************************************************************************/
+/* Poll the conversion started by ow_start_conversion. The sensor       */
+/* answers read slots with 0 while converting and 1 once it is done.    */
+/************************************************************************/
+unsigned char ow_conversion_done(void)
+{
+	return ow_read_bit() != 0;
+}
+
+/************************************************************************/
+/* Address one sensor by its ROM ID (Match ROM), or every sensor if     */
+/* rom is NULL (Skip ROM). Must follow a reset.                         */
+/************************************************************************/
+void ow_select(const uint8_t *rom)
+{
+	if (rom == NULL) {
+		ow_write_byte(0xCC); // Skip ROM
+		return;
+	}
+	ow_write_byte(0x55); // Match ROM
+	for (unsigned char i = 0; i < 8; i++) {
+		ow_write_byte(rom[i]);
+	}
+}
+
+/************************************************************************/
+/* Dallas/Maxim CRC8 of a buffer. A ROM ID or scratchpad followed by    */
+/* its own CRC byte gives 0.                                            */
+/************************************************************************/
+uint8_t ow_crc8(const uint8_t *data, uint8_t len)
+{
+	uint8_t crc = 0;
+	while (len--) {
+		crc = pgm_read_byte(&ow_crc8_table[crc ^ *data++]);
+	}
+	return crc;
+}
+
+/************************************************************************/
+/* Read the raw temperature register of one sensor. With CRC checking   */
+/* the whole scratchpad is read and verified; without it the read is    */
+/* cut short by a reset after the two temperature bytes.                */
+/* Returns 1 if the reading can be trusted.                             */
+/************************************************************************/
+static unsigned char ow_read_scratchpad(const uint8_t *rom, uint8_t *get)
+{
+	unsigned char k;
+	if (!ow_reset()) {
+		return 0; //nobody answered
+	}
+	ow_select(rom);
 	ow_write_byte(0xBE); // Read Scratch Pad
+	if (!ow_check_crc) {
+		get[0] = ow_read_byte();
+		get[1] = ow_read_byte();
+		ow_reset(); //terminate the read
+		return 1;
+	}
 	for (k=0; k<9; k++) {
 		get[k] = ow_read_byte();
 	}
-	temp_msb = get[1]; // Sign byte + lsbit
-	temp_lsb = get[0]; // Temp data plus lsb
-	if (temp_msb <= 0x80){temp_lsb = (temp_lsb>>shift_val) | (temp_msb<<(8-shift_val));} // shift to get whole degree
-	temp_msb = temp_msb & 0x80; // mask all but the sign bit
-	if (temp_msb >= 0x80) {temp_lsb = (~temp_lsb)+1;} // twos complement
-	if (temp_msb >= 0x80) {temp_lsb = (temp_lsb>>shift_val) | ((~temp_msb)<<(8-shift_val));}// shift to get whole degree
-	if (temp_msb >= 0x80) {temp_lsb = ((-1)*temp_lsb);} // add sign bit
-	temp_c = temp_lsb; // ready for conversion to Fahrenheit
-	return temp_c;
+	if (ow_crc8(get, 9) != 0) {
+		ow_errors.crc++;
+		return 0;
+	}
+	//a shorted bus reads all zeros, which passes the CRC
+	if (get[4] == 0) {
+		ow_errors.crc++;
+		return 0;
+	}
+	return 1;
+}
+
+/************************************************************************/
+/* Read the result of the last conversion from one sensor's scratchpad  */
+/* (rom == NULL reads the only sensor on the bus), retrying a bad read  */
+/* up to OW_READ_RETRIES times. Returns OW_NO_READING on failure.       */
+/************************************************************************/
+int ow_read_sensor(const uint8_t *rom)
+{
+	uint8_t get[9];
+	unsigned char tries = 0;
+	while (!ow_read_scratchpad(rom, get)) {
+		if (++tries > OW_READ_RETRIES) {
+			ow_errors.failed++;
+			return OW_NO_READING;
+		}
+		ow_errors.retries++;
+	}
+	//the register is already signed 1/16 degree; below 12 bits the low bits are undefined
+	int16_t temp = (int16_t) (get[0] | (get[1] << 8));
+	return temp & ~((1 << (12 - ow_resolution)) - 1);
+}
+
+/************************************************************************/
+/* Read the result of the last conversion from the only sensor          */
+/* (OW_NO_READING if it cannot be read)                                 */
+/************************************************************************/
+int ow_read_result(void)
+{
+	return ow_read_sensor(NULL);
+}
+
+/************************************************************************/
+/* Find the next device on the bus (Search ROM, Maxim AN187). rom       */
+/* holds the previous result on entry and the next ROM ID on return.    */
+/* Returns 1 if a device was found, 0 once the search is complete.      */
+/************************************************************************/
+unsigned char ow_search(uint8_t *rom)
+{
+	unsigned char id_bit_number = 1;
+	unsigned char last_zero = 0;
+	unsigned char rom_byte_number = 0;
+	unsigned char rom_byte_mask = 1;
+	unsigned char id_bit, cmp_id_bit, search_direction;
+
+	if (ow_last_device || !ow_reset()) {
+		ow_last_discrepancy = 0;
+		ow_last_device = 0;
+		return 0;
+	}
+	ow_write_byte(0xF0); // Search ROM
+
+	do {
+		//each device sends its ROM bit, then the complement
+		id_bit = ow_read_bit() != 0;
+		cmp_id_bit = ow_read_bit() != 0;
+		if (id_bit && cmp_id_bit) {
+			break; //no device answered
+		}
+		if (id_bit != cmp_id_bit) {
+			search_direction = id_bit; //all remaining devices agree
+		} else {
+			//discrepancy: retrace the previous path, then branch to 1 at the last fork
+			if (id_bit_number < ow_last_discrepancy) {
+				search_direction = (rom[rom_byte_number] & rom_byte_mask) != 0;
+			} else {
+				search_direction = (id_bit_number == ow_last_discrepancy);
+			}
+			if (!search_direction) {
+				last_zero = id_bit_number;
+			}
+		}
+		if (search_direction) {
+			rom[rom_byte_number] |= rom_byte_mask;
+		} else {
+			rom[rom_byte_number] &= ~rom_byte_mask;
+		}
+		ow_write_bit(search_direction); //deselect devices on the other branch
+		id_bit_number++;
+		rom_byte_mask <<= 1;
+		if (!rom_byte_mask) {
+			rom_byte_number++;
+			rom_byte_mask = 1;
+		}
+	} while (rom_byte_number < 8);
+
+	if (id_bit_number < 65) {
+		ow_last_discrepancy = 0;
+		ow_last_device = 0;
+		return 0;
+	}
+	ow_last_discrepancy = last_zero;
+	ow_last_device = (last_zero == 0);
+	return 1;
+}
+
+/************************************************************************/
+/* Enumerate the DS18B20s on the bus into ow_sensors. Returns count.    */
+/************************************************************************/
+unsigned char ow_search_sensors(void)
+{
+	uint8_t rom[8];
+
+	ow_last_discrepancy = 0;
+	ow_last_device = 0;
+	ow_sensor_count = 0;
+	while (ow_sensor_count < OW_MAX_SENSORS && ow_search(rom)) {
+		if (rom[0] == OW_FAMILY_DS18B20 && ow_crc8(rom, 8) == 0) {
+			memcpy(ow_sensors[ow_sensor_count].rom, rom, 8);
+			ow_sensors[ow_sensor_count].temp = 0;
+			ow_sensors[ow_sensor_count].valid = 0;
+			ow_sensor_count++;
+		}
+	}
+	ow_last_discrepancy = 0;
+	ow_last_device = 0;
+	return ow_sensor_count;
+}
+
+/************************************************************************/
+/* Save the sensor table's ROM IDs to EEPROM. Blocks for the writes;    */
+/* call only while config_busy() is clear.                              */
+/************************************************************************/
+void ow_save_sensors(void)
+{
+	for (unsigned char i = 0; i < ow_sensor_count; i++) {
+		eeprom_update_block(ow_sensors[i].rom, ow_ee_roms[i], 8);
+	}
+	eeprom_update_byte(&ow_ee_count, ow_sensor_count);
+}
+
+/************************************************************************/
+/* Fill the sensor table from the EEPROM cache. Returns count, 0 if     */
+/* nothing valid is stored; the caller then searches the bus and saves  */
+/* the result once the EEPROM is free (see config_busy).                */
+/************************************************************************/
+unsigned char ow_load_sensors(void)
+{
+	unsigned char count = eeprom_read_byte(&ow_ee_count);
+
+	if (count == 0 || count > OW_MAX_SENSORS) {
+		ow_sensor_count = 0;
+		return 0;
+	}
+	for (unsigned char i = 0; i < count; i++) {
+		eeprom_read_block(ow_sensors[i].rom, ow_ee_roms[i], 8);
+		ow_sensors[i].temp = 0;
+		ow_sensors[i].valid = 0;
+	}
+	ow_sensor_count = count;
+	return count;
+}
+
+/************************************************************************/
+/* Read every sensor in the table after one broadcast conversion.       */
+/* With an empty table the single sensor is read with Skip ROM into     */
+/* slot 0. A sensor that cannot be read keeps its last good reading     */
+/* and has valid cleared. Returns the number of table entries.          */
+/************************************************************************/
+unsigned char ow_read_all(void)
+{
+	unsigned char count = ow_sensor_count ? ow_sensor_count : 1;
+	for (unsigned char i = 0; i < count; i++) {
+		int temp = ow_read_sensor(ow_sensor_count ? ow_sensors[i].rom : NULL);
+		ow_sensors[i].valid = (temp != OW_NO_READING);
+		if (ow_sensors[i].valid) {
+			ow_sensors[i].temp = temp;
+		}
+	}
+	return count;
+}
+
+/************************************************************************/
+/* Read the current temperature from the sensor in 1/16 degree C.       */
+/* Busy-waits for the whole conversion (up to 750ms); threads should    */
+/* use ow_start_conversion and ow_read_result with x_delay between.     */
+/************************************************************************/
+int ow_read_temperature(void)
+{
+	ow_start_conversion();
+	while (!ow_conversion_done()) {
+	}
+	return ow_read_result();
 }
@@ -9,11 +9,59 @@
 #ifndef DS18B20_H_
 #define DS18B20_H_
 
-void delay_usec(int);
+#define OW_CONVERSION_MS	750	// worst-case 12-bit conversion time
+#define OW_POLL_MS			10	// interval between conversion-done polls
+#define OW_ALARM_HIGH		75	// TH and TL bytes written with the resolution;
+#define OW_ALARM_LOW		70	// the alarm search is not used
+
+#define OW_MAX_SENSORS		4		// size of the sensor table
+#define OW_FAMILY_DS18B20	0x28	// ROM family code of the DS18B20
+#define OW_READ_RETRIES		2		// extra scratchpad reads after a bad CRC
+#define OW_NO_READING		(-32767-1)	// returned when a sensor cannot be read
+
+/*
+ * One entry of the sensor table
+ */
+typedef struct {
+	uint8_t rom[8];		// 64-bit ROM ID (family, serial, CRC)
+	int temp;			// latest good reading in 1/16 degree Celsius
+	unsigned char valid;	// 1 if the last read succeeded
+} OW_SENSOR;
+
+/*
+ * Scratchpad read error counters
+ */
+typedef struct {
+	unsigned int crc;		// reads that failed the CRC (or read all zeros)
+	unsigned int retries;	// reads repeated after a failure
+	unsigned int failed;	// reads abandoned after OW_READ_RETRIES
+	unsigned int timeouts;	// transfers abandoned for lack of an echo (USART1 backend)
+} OW_ERRORS;
+
+extern OW_SENSOR ow_sensors[OW_MAX_SENSORS];
+extern unsigned char ow_sensor_count;
+extern unsigned char ow_check_crc;
+extern unsigned char ow_resolution;
+extern OW_ERRORS ow_errors;
+
 unsigned char ow_reset(void);
 unsigned char ow_read_bit();
 void ow_write_bit(char);
+unsigned char ow_read_byte(void);
 void ow_write_byte(char);
+unsigned char ow_start_conversion(void);
+unsigned int ow_conversion_ms(void);
+unsigned char ow_set_resolution(unsigned char);
+unsigned char ow_conversion_done(void);
+int ow_read_result(void);
+uint8_t ow_crc8(const uint8_t *, uint8_t);
+void ow_select(const uint8_t *);
+int ow_read_sensor(const uint8_t *);
+unsigned char ow_search(uint8_t *);
+unsigned char ow_search_sensors(void);
+void ow_save_sensors(void);
+unsigned char ow_load_sensors(void);
+unsigned char ow_read_all(void);
 int ow_read_temperature(void);
 
 #endif /* DS18B20_H_ */
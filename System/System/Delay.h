@@ -0,0 +1,40 @@
+/*
+ * Delay.h
+ *	Busy-wait delays generated from F_CPU, so timing-critical code (the 1-Wire
+ *  bit slots) stays exact at any clock. delay_us() turns a constant delay of up
+ *  to DELAY_INLINE_MAX_US into an inline, constant-folded cycle loop with no
+ *  call overhead; longer or variable delays call the calibrated loop in
+ *  delay_usec.S.
+ *
+ * Created: 10/19/2026
+ */
+
+
+#ifndef DELAY_H_
+#define DELAY_H_
+
+#include "System.h"
+
+#define DELAY_CYCLES_PER_US		(F_CPU / 1000000)	// no suffix: also used by delay_usec.S
+#define DELAY_INLINE_MAX_US		20		// longer constant delays call delay_usec
+
+#ifndef __ASSEMBLER__
+
+void delay_usec(unsigned int);
+
+/*
+ * 1 if us is a compile-time constant short enough to inline. Written so it is
+ * itself a constant expression even when us is a variable.
+ */
+#define DELAY_INLINE(us) ((__builtin_constant_p(us) ? (us) : DELAY_INLINE_MAX_US + 1) <= DELAY_INLINE_MAX_US)
+
+/*
+ * Busy-waits us microseconds.
+ */
+#define delay_us(us) __builtin_choose_expr(DELAY_INLINE(us), \
+	__builtin_avr_delay_cycles((unsigned long) (us) * DELAY_CYCLES_PER_US), \
+	delay_usec(us))
+
+#endif /* __ASSEMBLER__ */
+
+#endif /* DELAY_H_ */
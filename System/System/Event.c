@@ -0,0 +1,55 @@
+/*
+ * Event.c
+ *	Wake-up events between threads, built on x_suspend/x_resume_mask so a
+ *  waiting thread costs the scheduler nothing until the event is published.
+ *  event_publish may also be called from an ISR.
+ *
+ * Created: 10/19/2026
+ */
+
+#include <util/atomic.h>
+
+#include "acx.h"
+#include "Event.h"
+
+/*
+ * Counts one more occurrence of the event and readies every thread waiting on it.
+ *
+ * @param EVENT * event - the event
+ */
+void event_publish(EVENT *event)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		event->seq++;
+		x_resume_mask(event->waiters);
+		event->waiters = 0;
+	}
+}
+
+/*
+ * Sleeps until the event has been published since the caller saw count seen,
+ * returning at once if it already has. Publishes that happen while the caller
+ * is busy are not queued; the caller just sees the count jump.
+ *
+ * @param EVENT * event - the event
+ * @param uint8_t seen - the count returned by the previous call (or read from event->seq)
+ * @return uint8_t - the current count, to pass to the next call
+ */
+uint8_t event_wait(EVENT *event, uint8_t seen)
+{
+	while (event->seq == seen) {
+		char parked = 0;
+		//test and park with interrupts off, so a publish from an ISR is never missed
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+			if (event->seq == seen) {
+				event->waiters |= x_thread_mask;
+				x_suspend(x_getTID());
+				parked = 1;
+			}
+		}
+		if (parked) {
+			x_yield();
+		}
+	}
+	return event->seq;
+}
@@ -0,0 +1,28 @@
+/*
+ * Event.h
+ *	Wake-up events between threads. An event is a counter that the producer
+ *  bumps each time it publishes; a consumer remembers the last count it saw
+ *  and sleeps (x_suspend) until the count moves on, so a stage of a pipeline
+ *  only runs when its input has changed.
+ *
+ * Created: 10/19/2026
+ */
+
+
+#ifndef EVENT_H_
+#define EVENT_H_
+
+#include "System.h"
+
+typedef struct {
+	volatile uint8_t seq;		// number of publishes, mod 256
+	volatile byte waiters;		// thread masks sleeping on the event
+} EVENT;
+
+//
+// Function Prototypes
+//
+void event_publish(EVENT *);
+uint8_t event_wait(EVENT *, uint8_t);
+
+#endif /* EVENT_H_ */
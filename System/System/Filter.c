@@ -0,0 +1,85 @@
+/*
+ * Filter.c
+ *	Median and EMA filter. The median window is kept sorted as samples come
+ *  and go, so each sample costs one removal and one insertion into at most
+ *  FILTER_MEDIAN_MAX entries instead of a sort; the EMA is one multiply.
+ *  The EMA keeps 8 extra fraction bits so small alphas do not stall short
+ *  of the input.
+ *
+ * Created: 10/19/2026
+ */
+
+#include "Filter.h"
+
+/*
+ * Sets the median window (rounded down to odd, clamped to 1..FILTER_MEDIAN_MAX)
+ * and the EMA weight (1..FILTER_ALPHA_ONE) and forgets all samples.
+ */
+void filter_init(FILTER *f, uint8_t size, uint16_t alpha)
+{
+	if (size > FILTER_MEDIAN_MAX) {
+		size = FILTER_MEDIAN_MAX;
+	}
+	f->size = (size > 0) ? (size - 1) | 1 : 1;
+	f->alpha = (alpha < 1) ? 1 : (alpha > FILTER_ALPHA_ONE) ? FILTER_ALPHA_ONE : alpha;
+	filter_reset(f);
+}
+
+/*
+ * Forgets all samples; the next one passes straight through.
+ */
+void filter_reset(FILTER *f)
+{
+	f->count = 0;
+	f->oldest = 0;
+	f->primed = 0;
+}
+
+/*
+ * Adds one sample and returns the filtered value.
+ */
+int16_t filter_update(FILTER *f, int16_t temp)
+{
+	uint8_t i;
+
+	if (f->count == f->size) {
+		//drop the oldest sample from the sorted copy
+		int16_t old = f->window[f->oldest];
+		for (i = 0; f->sorted[i] != old; i++)
+			;
+		for (; i + 1 < f->count; i++) {
+			f->sorted[i] = f->sorted[i + 1];
+		}
+		f->count--;
+		f->window[f->oldest] = temp;
+		f->oldest = (f->oldest + 1 == f->size) ? 0 : f->oldest + 1;
+	} else {
+		f->window[(f->oldest + f->count) % f->size] = temp;
+	}
+
+	//insert the new sample in order
+	for (i = f->count; i > 0 && f->sorted[i - 1] > temp; i--) {
+		f->sorted[i] = f->sorted[i - 1];
+	}
+	f->sorted[i] = temp;
+	f->count++;
+
+	//while the window fills, the median of what is there
+	int32_t median = (int32_t) f->sorted[f->count >> 1] << 8;
+	if (!f->primed) {
+		f->ema = median;
+		f->primed = 1;
+	} else {
+		f->ema += (median - f->ema) * f->alpha >> 8;
+	}
+	return (f->ema + 128) >> 8;
+}
+
+/*
+ * Returns the median of the samples in the window, unsmoothed. Only valid
+ * after filter_update has been called since the last reset.
+ */
+int16_t filter_median(const FILTER *f)
+{
+	return f->sorted[f->count >> 1];
+}
@@ -0,0 +1,40 @@
+/*
+ * Filter.h
+ *	Fixed-point filtering for a temperature stream: a median-of-N spike
+ *  rejecter followed by an exponential moving average. Temperatures are
+ *  signed 1/16 degree Celsius.
+ *
+ * Created: 10/19/2026
+ */
+
+
+#ifndef FILTER_H_
+#define FILTER_H_
+
+#include <stdint.h>
+
+#define FILTER_MEDIAN_MAX		9		// longest median window (odd)
+#define FILTER_ALPHA_ONE		256		// EMA weight of 1: no smoothing
+#define FILTER_DEFAULT_MEDIAN	3		// rejects a single glitched reading
+#define FILTER_DEFAULT_ALPHA	FILTER_ALPHA_ONE
+
+typedef struct {
+	int16_t window[FILTER_MEDIAN_MAX];	// last samples in arrival order (a ring)
+	int16_t sorted[FILTER_MEDIAN_MAX];	// the same samples in ascending order
+	uint8_t size;						// median window, odd, 1..FILTER_MEDIAN_MAX
+	uint8_t count;						// samples held, up to size
+	uint8_t oldest;						// ring index of the oldest sample
+	uint16_t alpha;						// EMA weight of a new sample, 1/256
+	int32_t ema;						// EMA in 1/256 of 1/16 degree
+	uint8_t primed;						// ema holds a value
+} FILTER;
+
+//
+// Function Prototypes
+//
+void filter_init(FILTER *, uint8_t, uint16_t);
+void filter_reset(FILTER *);
+int16_t filter_update(FILTER *, int16_t);
+int16_t filter_median(const FILTER *);
+
+#endif /* FILTER_H_ */
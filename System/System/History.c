@@ -0,0 +1,270 @@
+/*
+ * History.c
+ *	Temperature history ring with rolling window statistics. The window sums
+ *  and sums of squares are updated as samples enter and leave it, and the
+ *  minimum and maximum come from monotonic queues of sample sequence numbers,
+ *  so adding a sample never rescans the window.
+ *
+ *  Sequence numbers are 8 bits and wrap; a window is never more than
+ *  HISTORY_SIZE <= 128 samples, so differences between them stay unambiguous.
+ *  Readers outside get 16-bit sequence numbers (the low bits of the same
+ *  count), so a cursor held across many new samples can tell how far the ring
+ *  has moved past it.
+ *  Sums assume DS18B20-range readings (|temp| < 2048, i.e. 128 degrees).
+ *
+ * Created: 10/19/2026
+ */
+
+#include <stddef.h>
+
+#include "History.h"
+
+#define HISTORY_MASK	(HISTORY_SIZE - 1)
+
+#if HISTORY_SIZE > 128 || (HISTORY_SIZE & HISTORY_MASK)
+#error "HISTORY_SIZE must be a power of two no larger than 128"
+#endif
+
+/*
+ * Sequence numbers of window samples in the order they arrived, pruned so
+ * that the front is always the window's minimum (or maximum).
+ */
+typedef struct {
+	uint8_t seq[HISTORY_SIZE];
+	uint8_t head;
+	uint8_t count;
+} HISTORY_QUEUE;
+
+static HISTORY_SAMPLE ring[HISTORY_SIZE];
+static uint8_t newest;						// sequence number of the newest sample
+static uint8_t stored = 0;					// samples in the ring
+static uint16_t added = 0;					// samples ever added: the 16-bit sequence number after the newest
+static uint8_t window = HISTORY_WINDOW;
+static uint8_t in_window = 0;				// samples currently in the window
+static int32_t window_sum;
+static uint32_t window_sumsq;
+static HISTORY_QUEUE min_queue;
+static HISTORY_QUEUE max_queue;
+
+static inline int16_t history_temp(uint8_t seq)
+{
+	return ring[seq & HISTORY_MASK].temp;
+}
+
+/*
+ * Appends seq to a queue, first dropping the samples it makes irrelevant:
+ * every later sample no better than it (greater for the minimum queue,
+ * smaller for the maximum queue).
+ */
+static void queue_push(HISTORY_QUEUE *q, uint8_t seq, uint8_t is_max)
+{
+	int16_t temp = history_temp(seq);
+
+	while (q->count)
+	{
+		int16_t back = history_temp(q->seq[(q->head + q->count - 1) & HISTORY_MASK]);
+		if (is_max ? (back > temp) : (back < temp))
+		{
+			break;
+		}
+		q->count--;
+	}
+	q->seq[(q->head + q->count) & HISTORY_MASK] = seq;
+	q->count++;
+}
+
+/*
+ * Drops samples that have left the window (oldest is the oldest sequence
+ * number still inside it) from the front of a queue.
+ */
+static void queue_expire(HISTORY_QUEUE *q, uint8_t oldest)
+{
+	while (q->count && (uint8_t) (q->seq[q->head] - oldest) >= window)
+	{
+		q->head = (q->head + 1) & HISTORY_MASK;
+		q->count--;
+	}
+}
+
+/*
+ * Adds a stored sample to the window.
+ */
+static void history_track(uint8_t seq)
+{
+	int16_t temp = history_temp(seq);
+
+	window_sum += temp;
+	window_sumsq += (int32_t) temp * temp;
+	in_window++;
+	queue_push(&min_queue, seq, 0);
+	queue_push(&max_queue, seq, 1);
+}
+
+/*
+ * Records a sample, overwriting the oldest once the ring is full.
+ *
+ * @param uint32_t time - sample time, x_gtime() milliseconds
+ * @param int16_t temp - temperature, 1/16 degree Celsius
+ */
+void history_add(uint32_t time, int16_t temp)
+{
+	uint8_t seq = newest + 1;
+
+	if (stored == 0)
+	{
+		seq = 0;
+	}
+	//the sample window + 1 back leaves the window (read it before the ring slot is reused)
+	if (in_window == window)
+	{
+		int16_t leaving = history_temp(seq - window);
+		window_sum -= leaving;
+		window_sumsq -= (int32_t) leaving * leaving;
+		in_window--;
+	}
+	queue_expire(&min_queue, seq - window + 1);
+	queue_expire(&max_queue, seq - window + 1);
+
+	ring[seq & HISTORY_MASK].time = time;
+	ring[seq & HISTORY_MASK].temp = temp;
+	newest = seq;
+	added++;
+	if (stored < HISTORY_SIZE)
+	{
+		stored++;
+	}
+	history_track(seq);
+}
+
+/*
+ * @return uint8_t - number of samples held
+ */
+uint8_t history_count(void)
+{
+	return stored;
+}
+
+/*
+ * @return uint8_t - statistics window, in samples
+ */
+uint8_t history_window(void)
+{
+	return window;
+}
+
+/*
+ * Sets the statistics window and rebuilds the window state from the
+ * samples already held (the only operation that is not O(1)).
+ *
+ * @param uint8_t size - window in samples, 1 .. HISTORY_SIZE
+ * @return uint8_t - 1 on success, 0 if size is out of range
+ */
+uint8_t history_set_window(uint8_t size)
+{
+	uint8_t n;
+
+	if (size < 1 || size > HISTORY_SIZE)
+	{
+		return 0;
+	}
+	window = size;
+	window_sum = 0;
+	window_sumsq = 0;
+	in_window = 0;
+	min_queue.head = min_queue.count = 0;
+	max_queue.head = max_queue.count = 0;
+	n = (stored < window) ? stored : window;
+	for (uint8_t seq = newest - n + 1; n; seq++, n--)
+	{
+		history_track(seq);
+	}
+	return 1;
+}
+
+/*
+ * Integer square root, rounded down.
+ */
+static uint16_t history_isqrt(uint32_t value)
+{
+	uint32_t root = 0;
+	uint32_t bit = 1UL << 30;
+
+	while (bit > value)
+	{
+		bit >>= 2;
+	}
+	while (bit)
+	{
+		if (value >= root + bit)
+		{
+			value -= root + bit;
+			root = (root >> 1) + bit;
+		}
+		else
+		{
+			root >>= 1;
+		}
+		bit >>= 2;
+	}
+	return root;
+}
+
+/*
+ * Fills in the statistics of the current window.
+ *
+ * @param HISTORY_STATS * stats - destination
+ */
+void history_stats(HISTORY_STATS *stats)
+{
+	uint8_t n = in_window;
+
+	stats->count = n;
+	if (n == 0)
+	{
+		stats->min = stats->max = stats->mean = stats->stddev = 0;
+		return;
+	}
+	stats->min = history_temp(min_queue.seq[min_queue.head]);
+	stats->max = history_temp(max_queue.seq[max_queue.head]);
+	stats->mean = (window_sum >= 0 ? window_sum + n / 2 : window_sum - n / 2) / n;
+	//n^2 * variance = n * sum(x^2) - sum(x)^2, exact in 64 bits
+	stats->stddev = history_isqrt(((int64_t) n * window_sumsq - (int64_t) window_sum * window_sum) / ((uint16_t) n * n));
+}
+
+/*
+ * @return uint16_t - sequence number the next sample will get; the oldest
+ *         held sample is history_end() - history_count()
+ */
+uint16_t history_end(void)
+{
+	return added;
+}
+
+/*
+ * Copies up to max held samples, oldest first, from sequence number *seq up
+ * to (not including) end, and advances *seq past them. Samples overwritten
+ * since *seq was taken are skipped. Each call copies a consistent run, so a
+ * reader that yields between calls never sees a slot change under it.
+ *
+ * @param uint16_t * seq - cursor, from history_end() - history_count()
+ * @param uint16_t end - history_end() when the reader started
+ * @param HISTORY_SAMPLE * dst - destination for max samples
+ * @param uint8_t max - samples wanted
+ * @return uint8_t - samples copied; 0 once the cursor reaches end
+ */
+uint8_t history_read(uint16_t *seq, uint16_t end, HISTORY_SAMPLE *dst, uint8_t max)
+{
+	uint16_t oldest = added - stored;
+	uint8_t n = 0;
+
+	if ((int16_t) (*seq - oldest) < 0)
+	{
+		*seq = ((int16_t) (end - oldest) < 0) ? end : oldest;	//everything up to end may be gone
+	}
+	while (n < max && (int16_t) (end - *seq) > 0)
+	{
+		dst[n++] = ring[*seq & HISTORY_MASK];
+		(*seq)++;
+	}
+	return n;
+}
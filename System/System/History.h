@@ -0,0 +1,50 @@
+/*
+ * History.h
+ *	Ring of the most recent timestamped temperature samples, with rolling
+ *  minimum, maximum, mean and variance over a configurable window of the
+ *  newest samples, all kept up to date in O(1) (amortized) per sample.
+ *
+ * Created: 10/19/2026
+ */
+
+
+#ifndef HISTORY_H_
+#define HISTORY_H_
+
+#include <stdint.h>
+
+#define HISTORY_SIZE		128		// samples kept; a power of two, at most 128
+#define HISTORY_WINDOW		32		// default statistics window
+
+/*
+ * One sample. On the AVR this is 6 bytes, little endian, no padding, which
+ * is also its layout in a TLM_HISTORY packet.
+ */
+typedef struct {
+	uint32_t time;			// x_gtime() milliseconds
+	int16_t temp;			// 1/16 degree Celsius
+} HISTORY_SAMPLE;
+
+/*
+ * Statistics over the window
+ */
+typedef struct {
+	uint8_t count;			// samples in the window (0 if there are none yet)
+	int16_t min;			// 1/16 degree Celsius
+	int16_t max;
+	int16_t mean;
+	int16_t stddev;
+} HISTORY_STATS;
+
+//
+// Function Prototypes
+//
+void history_add(uint32_t, int16_t);
+uint8_t history_count(void);
+uint8_t history_window(void);
+uint8_t history_set_window(uint8_t);
+void history_stats(HISTORY_STATS *);
+uint16_t history_end(void);
+uint8_t history_read(uint16_t *, uint16_t, HISTORY_SAMPLE *, uint8_t);
+
+#endif /* HISTORY_H_ */
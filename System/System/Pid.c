@@ -0,0 +1,86 @@
+/*
+ * Pid.c
+ *	Fixed-point PID controller with conditional-integration anti-windup:
+ *  the integral only grows while the output is not saturated in the
+ *  direction of the error, and never beyond the output range.
+ *
+ * Created: 10/19/2026
+ */
+
+#include "Pid.h"
+
+/*
+ * Clamps value to +-limit.
+ */
+static int32_t pid_clamp(int32_t value, int32_t limit)
+{
+	if (value > limit)
+	{
+		return limit;
+	}
+	if (value < -limit)
+	{
+		return -limit;
+	}
+	return value;
+}
+
+/*
+ * Sets the gains and clears the controller state.
+ *
+ * @param PID * pid - the controller
+ * @param int16_t kp, ki, kd - gains in 1/16 permille per degree
+ */
+void pid_init(PID *pid, int16_t kp, int16_t ki, int16_t kd)
+{
+	pid->kp = kp;
+	pid->ki = ki;
+	pid->kd = kd;
+	pid_reset(pid);
+}
+
+/*
+ * Clears the integral and derivative history, e.g. after the output has
+ * been driven by hand.
+ *
+ * @param PID * pid - the controller
+ */
+void pid_reset(PID *pid)
+{
+	pid->integral = 0;
+	pid->primed = 0;
+}
+
+/*
+ * Runs one controller update. Call once per new measurement.
+ *
+ * @param PID * pid - the controller
+ * @param int16_t setpoint - target temperature, 1/16 degree Celsius
+ * @param int16_t input - measured temperature, 1/16 degree Celsius
+ * @return int16_t - output, -PID_OUTPUT_MAX (cool) .. PID_OUTPUT_MAX (heat)
+ */
+int16_t pid_update(PID *pid, int16_t setpoint, int16_t input)
+{
+	const int32_t limit = (int32_t) PID_OUTPUT_MAX << PID_SHIFT;
+	int32_t error = pid_clamp((int32_t) setpoint - input, PID_ERROR_MAX);
+	int32_t delta = 0;
+	int32_t integral;
+	int32_t output;
+
+	if (pid->primed)
+	{
+		delta = pid_clamp((int32_t) input - pid->last_input, PID_ERROR_MAX);
+	}
+	pid->last_input = input;
+	pid->primed = 1;
+
+	integral = pid_clamp(pid->integral + (int32_t) pid->ki * error, limit);
+	output = (int32_t) pid->kp * error + integral - (int32_t) pid->kd * delta;
+
+	//anti-windup: keep the new integral only if it does not push further into saturation
+	if (!((output > limit && error > 0) || (output < -limit && error < 0)))
+	{
+		pid->integral = integral;
+	}
+	return pid_clamp(output, limit) >> PID_SHIFT;
+}
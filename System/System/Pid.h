@@ -0,0 +1,45 @@
+/*
+ * Pid.h
+ *	Fixed-point PID controller. Temperatures are signed 1/16 degree Celsius,
+ *  the output is signed permille (-1000 full cooling .. 1000 full heating) and
+ *  the gains are 1/16 permille per degree, so an update costs a few 32-bit
+ *  multiplies and no floating point.
+ *
+ * Created: 10/19/2026
+ */
+
+
+#ifndef PID_H_
+#define PID_H_
+
+#include <stdint.h>
+
+#define PID_OUTPUT_MAX		1000	// permille
+#define PID_SHIFT			8		// gain (Q4) * error (Q4) -> Q8 permille
+#define PID_ERROR_MAX		(128 * 16)	// errors are clamped to +-128 degrees
+
+/*
+ * Default gains, 1/16 permille per degree (Kp), per degree-sample (Ki)
+ * and per degree/sample (Kd)
+ */
+#define PID_DEFAULT_KP		(200 * 16)
+#define PID_DEFAULT_KI		(2 * 16)
+#define PID_DEFAULT_KD		(400 * 16)
+
+typedef struct {
+	int16_t kp;				// proportional gain
+	int16_t ki;				// integral gain, applied once per update
+	int16_t kd;				// derivative gain, on the measurement to avoid setpoint kick
+	int32_t integral;		// integral term, Q8 permille
+	int16_t last_input;		// measurement of the previous update
+	uint8_t primed;			// last_input is valid
+} PID;
+
+//
+// Function Prototypes
+//
+void pid_init(PID *, int16_t, int16_t, int16_t);
+void pid_reset(PID *);
+int16_t pid_update(PID *, int16_t, int16_t);
+
+#endif /* PID_H_ */
@@ -0,0 +1,230 @@
+/*
+ * Pwm.c
+ *	Outputs for the heater lamps and fans. The lamps are time-proportioned:
+ *  TIMER1 ticks every PWM_HEATER_TICK_MS and each lamp is on for the first
+ *  part of every PWM_HEATER_WINDOW_MS window, so its relay/SSR switches at
+ *  most twice a window. The fans run on TIMER2, TIMER4 and TIMER5 in
+ *  inverting 8-bit fast PWM at the same rate, so the duty cycle is the time
+ *  the active-low pin is held low; a duty of 0 disconnects the timer and holds
+ *  the pin high, so an idle load never sees a one-tick pulse.
+ *
+ * Created: 10/19/2026
+ */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include <stddef.h>
+
+#include "System.h"
+#include "Pwm.h"
+
+#define PWM_HEATER_TOP	(F_CPU / 256 / (1000 / PWM_HEATER_TICK_MS) - 1)	// TIMER1 at clkIO/256
+#define PWM_FAN_TOP		0xFF								// 8-bit, clkIO/1024 (61 Hz at 16 MHz)
+
+#if PWM_HEATER_TOP > 0xFFFF
+#error "PWM_HEATER_TICK_MS too long for TIMER1 at this F_CPU"
+#endif
+
+#if PWM_HEATER_TICKS > 0xFF || PWM_HEATER_MIN_TICKS * 2 > PWM_HEATER_TICKS
+#error "PWM_HEATER_WINDOW_MS must be 255 ticks or fewer and hold an on and an off stretch"
+#endif
+
+#if ZONE_COUNT > PWM_CHANNELS
+#error "ZONE_COUNT needs more heater/fan channels than the heater pins and TIMER2/4/5 provide"
+#endif
+
+/*
+ * One output pin and the compare-output bits that connect it to its timer
+ */
+typedef struct {
+	volatile uint8_t *port;
+	volatile uint8_t *ddr;
+	uint8_t pin;
+	uint8_t com;			// COMnx1 | COMnx0: inverting PWM; 0 for a pin switched by the window ISR
+	volatile uint8_t *tccra;	// TCCRnA of the pin's timer, which holds the com bits
+	volatile uint8_t *ocr;		// TIMER2's 8-bit compare register, or
+	volatile uint16_t *ocr16;	// TIMER4/5's 16-bit one (run as 8-bit)
+} PWM_PIN;
+
+static const PWM_PIN heater_pins[PWM_CHANNELS] = {
+	{&PORTB, &DDRB, PB5, 0, NULL, NULL, NULL},	// Digital pin 11
+	{&PORTB, &DDRB, PB6, 0, NULL, NULL, NULL},	// Digital pin 12
+	{&PORTA, &DDRA, PA0, 0, NULL, NULL, NULL},	// Digital pin 22
+	{&PORTA, &DDRA, PA1, 0, NULL, NULL, NULL},	// Digital pin 23
+	{&PORTA, &DDRA, PA2, 0, NULL, NULL, NULL},	// Digital pin 24
+	{&PORTA, &DDRA, PA3, 0, NULL, NULL, NULL},	// Digital pin 25
+	{&PORTA, &DDRA, PA4, 0, NULL, NULL, NULL},	// Digital pin 26
+	{&PORTA, &DDRA, PA5, 0, NULL, NULL, NULL}	// Digital pin 27
+};
+
+static const PWM_PIN fan_pins[PWM_CHANNELS] = {
+	{&PORTB, &DDRB, PB4, (1 << COM2A1) | (1 << COM2A0), &TCCR2A, &OCR2A, NULL},		// OC2A, Digital pin 10
+	{&PORTH, &DDRH, PH6, (1 << COM2B1) | (1 << COM2B0), &TCCR2A, &OCR2B, NULL},		// OC2B, Digital pin 9
+	{&PORTH, &DDRH, PH3, (1 << COM4A1) | (1 << COM4A0), &TCCR4A, NULL, &OCR4A},		// OC4A, Digital pin 6
+	{&PORTH, &DDRH, PH4, (1 << COM4B1) | (1 << COM4B0), &TCCR4A, NULL, &OCR4B},		// OC4B, Digital pin 7
+	{&PORTH, &DDRH, PH5, (1 << COM4C1) | (1 << COM4C0), &TCCR4A, NULL, &OCR4C},		// OC4C, Digital pin 8
+	{&PORTL, &DDRL, PL3, (1 << COM5A1) | (1 << COM5A0), &TCCR5A, NULL, &OCR5A},		// OC5A, Digital pin 46
+	{&PORTL, &DDRL, PL4, (1 << COM5B1) | (1 << COM5B0), &TCCR5A, NULL, &OCR5B},		// OC5B, Digital pin 45
+	{&PORTL, &DDRL, PL5, (1 << COM5C1) | (1 << COM5C0), &TCCR5A, NULL, &OCR5C}		// OC5C, Digital pin 44
+};
+
+static uint16_t heater_duty[PWM_CHANNELS];
+static uint16_t fan_duty[PWM_CHANNELS];
+
+/*
+ * Window state, owned by the TIMER1 ISR except where pwm_set_heater turns a lamp off
+ */
+static uint8_t heater_tick;							// ticks into the current window
+static volatile uint8_t heater_on[PWM_CHANNELS];	// on ticks of the current window
+static int16_t heater_carry[PWM_CHANNELS];			// see pwm_heater_window
+
+/*
+ * Window tick. Each lamp is on for the first heater_on ticks of the window;
+ * at the start of a window the on time is taken from the duty now set.
+ */
+ISR(TIMER1_COMPA_vect)
+{
+	if (++heater_tick == PWM_HEATER_TICKS)
+	{
+		heater_tick = 0;
+	}
+	for (uint8_t i = 0; i < ZONE_COUNT; i++)
+	{
+		if (heater_tick == 0)
+		{
+			heater_on[i] = pwm_heater_window(heater_duty[i], &heater_carry[i]);
+		}
+		if (heater_tick < heater_on[i])
+		{
+			*heater_pins[i].port &= ~(1 << heater_pins[i].pin);
+		}
+		else
+		{
+			*heater_pins[i].port |= (1 << heater_pins[i].pin);
+		}
+	}
+}
+
+/*
+ * Sets up both timers with every load off.
+ */
+void pwm_init(void)
+{
+	for (uint8_t i = 0; i < ZONE_COUNT; i++)
+	{
+		//off while the timers start
+		*heater_pins[i].port |= (1 << heater_pins[i].pin);
+		*heater_pins[i].ddr |= (1 << heater_pins[i].pin);
+		*fan_pins[i].port |= (1 << fan_pins[i].pin);
+		*fan_pins[i].ddr |= (1 << fan_pins[i].pin);
+		heater_duty[i] = 0;
+		heater_on[i] = 0;
+		heater_carry[i] = 0;
+		fan_duty[i] = 0;
+	}
+
+	//TIMER1: CTC, TOP = OCR1A (mode 4), clkIO/256, interrupt every window tick
+	heater_tick = PWM_HEATER_TICKS - 1;	//the first tick starts a window
+	TCCR1A = 0;
+	TCCR1B = (1 << WGM12) | (1 << CS12);
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		OCR1A = PWM_HEATER_TOP;
+	}
+	TIMSK1 |= (1 << OCIE1A);
+
+	//TIMER2: fast PWM, TOP = 0xFF (mode 3), clkIO/1024
+	TCCR2A = (1 << WGM21) | (1 << WGM20);
+	TCCR2B = (1 << CS22) | (1 << CS21) | (1 << CS20);
+#if ZONE_COUNT > 2
+	//TIMER4: 8-bit fast PWM (mode 5), clkIO/1024, the same rate as TIMER2
+	TCCR4A = (1 << WGM40);
+	TCCR4B = (1 << WGM42) | (1 << CS42) | (1 << CS40);
+#endif
+#if ZONE_COUNT > 5
+	//TIMER5: as TIMER4
+	TCCR5A = (1 << WGM50);
+	TCCR5B = (1 << WGM52) | (1 << CS52) | (1 << CS50);
+#endif
+}
+
+/*
+ * Sets a zone's heater lamp duty cycle. It takes effect at the start of the
+ * next window, except that a duty of 0 turns the lamp off at once.
+ *
+ * @param uint8_t zone - the zone (PWM channel)
+ * @param uint16_t duty - permille, 0 (off) .. PWM_MAX (on)
+ */
+void pwm_set_heater(uint8_t zone, uint16_t duty)
+{
+	if (duty > PWM_MAX)
+	{
+		duty = PWM_MAX;
+	}
+	//the ISR reads the duty and shares the port with the other lamp
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		heater_duty[zone] = duty;
+		if (duty == 0)
+		{
+			heater_on[zone] = 0;
+			*heater_pins[zone].port |= (1 << heater_pins[zone].pin);
+		}
+	}
+}
+
+/*
+ * Sets a zone's fan duty cycle.
+ *
+ * @param uint8_t zone - the zone (PWM channel)
+ * @param uint16_t duty - permille, 0 (off) .. PWM_MAX (on)
+ */
+void pwm_set_fan(uint8_t zone, uint16_t duty)
+{
+	if (duty > PWM_MAX)
+	{
+		duty = PWM_MAX;
+	}
+	fan_duty[zone] = duty;
+	//a timer's channels share TCCRnA, which another zone's thread may also change
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		const PWM_PIN *p = &fan_pins[zone];
+		if (duty == 0)
+		{
+			*p->tccra &= ~p->com;
+		}
+		else
+		{
+			uint8_t level = (uint32_t) PWM_FAN_TOP * duty / PWM_MAX;
+			if (p->ocr)
+			{
+				*p->ocr = level;
+			}
+			else
+			{
+				*p->ocr16 = level;
+			}
+			*p->tccra |= p->com;
+		}
+	}
+}
+
+/*
+ * @param uint8_t zone - the zone (PWM channel)
+ * @return uint16_t - current heater duty cycle, permille
+ */
+uint16_t pwm_heater(uint8_t zone)
+{
+	return heater_duty[zone];
+}
+
+/*
+ * @param uint8_t zone - the zone (PWM channel)
+ * @return uint16_t - current fan duty cycle, permille
+ */
+uint16_t pwm_fan(uint8_t zone)
+{
+	return fan_duty[zone];
+}
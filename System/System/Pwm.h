@@ -0,0 +1,64 @@
+/*
+ * Pwm.h
+ *	Outputs for each zone: the heater lamps, time-proportioned over a slow
+ *  window ticked by TIMER1 (zones 0-1 on PB5-PB6, zones 2-7 on PA0-PA5), and
+ *  the fans on hardware PWM (zones 0-1 on OC2A/OC2B, zones 2-4 on OC4A-OC4C,
+ *  zones 5-7 on OC5A-OC5C; see Pwm.c for the pins). All loads are active low.
+ *  Duty cycles are in permille.
+ *
+ * Created: 10/19/2026
+ */
+
+
+#ifndef PWM_H_
+#define PWM_H_
+
+#include <stdint.h>
+
+#define PWM_CHANNELS		8		// heater/fan pairs the timers provide
+#define PWM_MAX				1000	// permille, fully on
+#define PWM_HEATER_WINDOW_MS	20000	// time-proportioning window of the lamps
+#define PWM_HEATER_TICK_MS	100		// resolution of the window
+#define PWM_HEATER_MIN_MS	1000	// shortest on or off stretch the lamps' relay/SSR sees
+#define PWM_HEATER_TICKS	(PWM_HEATER_WINDOW_MS / PWM_HEATER_TICK_MS)
+#define PWM_HEATER_MIN_TICKS	(PWM_HEATER_MIN_MS / PWM_HEATER_TICK_MS)
+#define PWM_FAN_DEFAULT		300		// fan duty that keeps the air moving
+
+/*
+ * Returns the ticks a heater is on for in the window that is starting. On or
+ * off stretches shorter than PWM_HEATER_MIN_TICKS are not switched; the time
+ * they stood for is carried into the next window so the mean duty holds.
+ * Shared with Tools/thermal_sim.c so the simulated lamps switch the same way.
+ *
+ * @param uint16_t duty - heater duty, permille
+ * @param int16_t * carry - the heater's carried ticks, 0 at start
+ * @return uint8_t - on ticks, 0 .. PWM_HEATER_TICKS
+ */
+static inline uint8_t pwm_heater_window(uint16_t duty, int16_t *carry)
+{
+	int16_t on = (int16_t) (((uint32_t) duty * PWM_HEATER_TICKS + PWM_MAX / 2) / PWM_MAX) + *carry;
+
+	if (duty == 0 || on < PWM_HEATER_MIN_TICKS)
+	{
+		*carry = (duty == 0) ? 0 : on;
+		return 0;
+	}
+	if (on > PWM_HEATER_TICKS - PWM_HEATER_MIN_TICKS)
+	{
+		*carry = (on > PWM_HEATER_TICKS) ? 0 : on - PWM_HEATER_TICKS;
+		return PWM_HEATER_TICKS;
+	}
+	*carry = 0;
+	return on;
+}
+
+//
+// Function Prototypes
+//
+void pwm_init(void);
+void pwm_set_heater(uint8_t, uint16_t);
+void pwm_set_fan(uint8_t, uint16_t);
+uint16_t pwm_heater(uint8_t);
+uint16_t pwm_fan(uint8_t);
+
+#endif /* PWM_H_ */
@@ -40,7 +40,7 @@ byte Q_putc(byte qid, char data)
 
 			if (((qcb->in + 1) & qcb->smask) != qcb->out) //Checks if queue has wrapped around
 			{
-				qcb->in = (qcb->in + 1) & qcb->smask //If not, increments the value for next slot
+				qcb->in = (qcb->in + 1) & qcb->smask; //If not, increments the value for next slot
 			}
 			else
 			{
@@ -150,17 +150,5 @@ int Q_unused(byte qid)
 	{
 		return -1;
 	}
-
-	if (queues[qid].out > queues[qid].in)
-	{
-		return (queues[qid].out - queues[qid].in);
-	}
-	else if (queues[qid].in > queues[qid].out)
-	{
-		return ((queues[qid].smask + 1) - (queues[qid].in - queues[qid].out));
-	}
-	else
-	{
-		return 0;
-	}
+	return (queues[qid].smask + 1) - queues[qid].available; //in == out is both empty and full
 }
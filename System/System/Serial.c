@@ -6,9 +6,11 @@
  */
 #include <avr/io.h>
 #include <avr/interrupt.h>
+#include <avr/pgmspace.h>
 #include <util/atomic.h>
 #include <stdlib.h>
 
+#include "System.h"
 #include "Queues.h"
 #include "acx.h"
 #include "Serial.h"
@@ -17,47 +19,286 @@ char buffer[QCB_MAX_COUNT][64];
 
 //Initialize serial ports.
 SERIAL_PORT ports[4] = {
-	{0, 0, buffer[0], P0_RX_BUFFER_SIZE, buffer[1], P0_TX_BUFFER_SIZE},
-	{0, 0, buffer[2], P1_RX_BUFFER_SIZE, buffer[3], P1_TX_BUFFER_SIZE},
-	{0, 0, buffer[4], P2_RX_BUFFER_SIZE, buffer[5], P2_TX_BUFFER_SIZE},
-	{0, 0, buffer[6], P3_RX_BUFFER_SIZE, buffer[7], P3_TX_BUFFER_SIZE}
+	{0, 0, buffer[0], P0_RX_BUFFER_SIZE, buffer[1], P0_TX_BUFFER_SIZE, 0, 0, {0x0D, 0x0A}, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+	{0, 0, buffer[2], P1_RX_BUFFER_SIZE, buffer[3], P1_TX_BUFFER_SIZE, 0, 0, {0x0D, 0x0A}, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+	{0, 0, buffer[4], P2_RX_BUFFER_SIZE, buffer[5], P2_TX_BUFFER_SIZE, 0, 0, {0x0D, 0x0A}, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+	{0, 0, buffer[6], P3_RX_BUFFER_SIZE, buffer[7], P3_TX_BUFFER_SIZE, 0, 0, {0x0D, 0x0A}, 0, 0, 0, 0, 0, 0, 0, 0, 0}
 };
 
-//Initialize serial regs
-SERIAL_PORT_REGS *regs[4] = {
-	(SERIAL_PORT_REGS *) 0xC0,
-	(SERIAL_PORT_REGS *) 0xC8,
-	(SERIAL_PORT_REGS *) 0xD0,
-	(SERIAL_PORT_REGS *) 0x130
-};
+//Receive error counters, one set per port
+SERIAL_ERRORS serial_errors[4];
 
+//A port ID the serial API may use: 0-3, except USART1 while it is the 1-Wire master (OW_USE_USART1)
+#define SERIAL_PORT_VALID(port)	((port) >= 0 && (port) <= 3 && !(OW_USE_USART1 && (port) == 1))
 
 /*
-* Serial_open
+* SERIAL_PORT_DRIVER(n)
 *
-* Serial_open configures the specified serial port (USART) for operation according the specified baud rate and configuration.
-* It uses Queue functions to allocate a QCB to manage transmit and receive buffers. It initializes the interface between the
-* ISRs (RXC and UDRE) and the queues for the port by initializing the QCB "handles" to be used by the ISRs. The RXCx interrupt is enabled.
-* Serial_open returns 0 for success and -1 if an error occurs (e.g., bad port ID, baud rate, frame parameters or invalid buffer sizes).
+* Expands to the queued driver for USARTn: the setup/shutdown/tx_start/poll_write helpers used by the port-generic
+* functions below, Serialn_write, and the UDRE and RX ISRs. Every register is named directly (UCSRnB, UDRn, ...) so the
+* ISRs and writes compile to direct I/O instructions instead of loads through a table of register blocks.
+* SERIAL_PORT_FUNCTIONS(n) is the driver without its ISRs, for a USART whose interrupts belong to another driver.
+*/
+#define SERIAL_PORT_DRIVER(n) \
+SERIAL_PORT_FUNCTIONS(n) \
+SERIAL_PORT_ISRS(n)
+
+#define SERIAL_PORT_FUNCTIONS(n) \
+static void serial##n##_setup(uint16_t ubrr, uint8_t config) \
+{ \
+	UCSR##n##A |= (1<<U2X##n); /* Sets U2Xn to 1 for lowest error rate */ \
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) \
+	{ \
+		UBRR##n = ubrr; \
+		UCSR##n##C = config; \
+		UCSR##n##B = (1<<RXEN##n) | (1<<TXEN##n) | (1<<RXCIE##n); \
+	} \
+} \
+\
+static void serial##n##_shutdown(void) \
+{ \
+	UCSR##n##B = 0; \
+} \
+\
+static void serial##n##_tx_start(void) \
+{ \
+	if (!ports[n].polled) \
+	{ \
+		UCSR##n##B |= (1<<UDRIE##n); \
+	} \
+} \
+\
+static void serial##n##_poll_write(char data) \
+{ \
+	uint8_t sent = 0; \
+	/* wait for UDRE with interrupts on (a character takes 520us at 19200 baud, and the 1-Wire \
+	   slot ISR must not be held off that long); only the final check-and-write is atomic, \
+	   so an ISR writing to the port in between cannot slip a byte in ahead of the check */ \
+	while (!sent) \
+	{ \
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE) \
+		{ \
+			if (UCSR##n##A & (1<<UDRE##n)) \
+			{ \
+				UDR##n = data; \
+				sent = 1; \
+			} \
+		} \
+	} \
+} \
+\
+int Serial##n##_write(char data) \
+{ \
+	if (!SERIAL_PORT_VALID(n)) \
+	{ \
+		return -1; /* no UDRE ISR would ever drain the queue */ \
+	} \
+	if (ports[n].polled) \
+	{ \
+		serial##n##_poll_write(data); \
+		return 1; \
+	} \
+	if (Q_putc(ports[n].tx_qid, data)) \
+	{ \
+		serial##n##_tx_start(); \
+		return 1; \
+	} \
+	return -1; \
+}
+
+#define SERIAL_PORT_ISRS(n) \
+ISR(USART##n##_UDRE_vect) \
+{ \
+	char data; \
+	if (PINK & ports[n].cts_mask) \
+	{ \
+		/* CTS deasserted: pause until the PCINT2 ISR sees it asserted again */ \
+		UCSR##n##B &= ~(1<<UDRIE##n); \
+		return; \
+	} \
+	if (Q_getc(ports[n].tx_qid, &data)) \
+	{ \
+		UDR##n = data; \
+	} \
+	else \
+	{ \
+		UCSR##n##B &= ~(1<<UDRIE##n); \
+	} \
+	/* wake parked writers once half the queue is free, so they refill in bulk */ \
+	if (ports[n].tx_waiters && Q_used(ports[n].tx_qid) <= (ports[n].tx_bufsize >> 1)) \
+	{ \
+		x_resume_mask(ports[n].tx_waiters); \
+		ports[n].tx_waiters = 0; \
+	} \
+} \
+\
+ISR(USART##n##_RX_vect) \
+{ \
+	uint8_t status = UCSR##n##A; /* error flags are only valid before UDRn is read */ \
+	char data = UDR##n; \
+	if (status & ((1<<DOR##n) | (1<<FE##n) | (1<<UPE##n))) \
+	{ \
+		if (status & (1<<DOR##n)) \
+		{ \
+			serial_errors[n].overrun++; \
+		} \
+		if (status & (1<<FE##n)) \
+		{ \
+			serial_errors[n].framing++; \
+			return; \
+		} \
+		if (status & (1<<UPE##n)) \
+		{ \
+			serial_errors[n].parity++; \
+			return; \
+		} \
+	} \
+	if (ports[n].rx_discard) \
+	{ \
+		/* the tail of a line already handed over as overlong: drop it with its terminator, \
+		   so it is never read as a line of its own */ \
+		if (data == ports[n].eol[0] || data == ports[n].eol[1]) \
+		{ \
+			ports[n].rx_discard = 0; \
+		} \
+		return; \
+	} \
+	uint8_t queued = Q_putc(ports[n].rx_qid, data); \
+	uint8_t high = Q_used(ports[n].rx_qid) >= ports[n].rx_bufsize - (ports[n].rx_bufsize >> 2); \
+	if (high && ports[n].rts_mask) \
+	{ \
+		PORTK |= ports[n].rts_mask; /* deassert RTS above the 3/4 watermark */ \
+	} \
+	if (queued) \
+	{ \
+		if (!ports[n].line_mode) \
+		{ \
+			return; \
+		} \
+		if (data == ports[n].eol[0] || data == ports[n].eol[1]) \
+		{ \
+			ports[n].rx_lines++; \
+		} \
+		else if (high && ports[n].rts_mask && !ports[n].rx_lines) \
+		{ \
+			/* a partial line reached the watermark: with RTS deasserted no terminator \
+			   may ever come, so hand it to the reader as overlong, which drains the queue */ \
+			ports[n].rx_lines = 1; \
+			ports[n].rx_discard = 1; \
+		} \
+		else \
+		{ \
+			return; \
+		} \
+	} \
+	else \
+	{ \
+		serial_errors[n].dropped++; \
+		if (!ports[n].line_mode || ports[n].rx_lines) \
+		{ \
+			return; \
+		} \
+		/* queue full with no terminator: hand the overlong line to the reader */ \
+		ports[n].rx_lines = 1; \
+		ports[n].rx_discard = 1; \
+	} \
+	if (ports[n].rx_waiters) \
+	{ \
+		x_resume_mask(ports[n].rx_waiters); \
+		ports[n].rx_waiters = 0; \
+	} \
+}
+
+SERIAL_PORT_DRIVER(0)
+#if OW_USE_USART1
+SERIAL_PORT_FUNCTIONS(1) //USART1 is the 1-Wire master (DS18B20.c)
+#else
+SERIAL_PORT_DRIVER(1)
+#endif
+SERIAL_PORT_DRIVER(2)
+SERIAL_PORT_DRIVER(3)
+
+/*
+* serial_tx_start
 *
-* @param int port - specifies USART 0, 1, 2 or 3. For right now, 0 is the only one active.
-* @param long speed - baud rate
-* @param constant that specifies framing parameters (data bits, parity, stop bits)
-* @return returns 0 for success and -1 if an error occurs
+* Enables the UDRE interrupt of the specified port so that its ISR drains the TX queue.
+*
+* @param int port - the port ID
 */
-int Serial_open(int port, long speed, int config)
+static void serial_tx_start(int port)
 {
-	if (port < 0 || port > 3)
+	switch(port)
 	{
-		return -1;
+		case 0:
+		serial0_tx_start();
+		break;
+
+		case 1:
+		serial1_tx_start();
+		break;
+
+		case 2:
+		serial2_tx_start();
+		break;
+
+		case 3:
+		serial3_tx_start();
+		break;
 	}
-	//Creates a Rqueue forRX and TX
-	ports[port].rx_qid = Q_create(ports[port].rx_bufsize, ports[port].rx_buffer);
-	ports[port].tx_qid = Q_create(ports[port].tx_bufsize, ports[port].tx_buffer);
+}
+
+/*
+* serial_rx_drained
+*
+* Re-asserts RTS on a flow-controlled port once a reader has drained its RX queue below the 1/4 watermark.
+*
+* @param int port - the port ID
+*/
+static void serial_rx_drained(int port)
+{
+	uint8_t mask = ports[port].rts_mask;
+	if (!mask)
+	{
+		return;
+	}
+	//test and clear together, so an RX ISR that deasserts RTS in between is not undone
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		if ((PORTK & mask) && Q_used(ports[port].rx_qid) <= (ports[port].rx_bufsize >> 2))
+		{
+			PORTK &= ~mask;
+		}
+	}
+}
 
-	//Sets U2X0 to 1 for lowest error rate
-	regs[port]->ucsra |= (1<<U2X0); //Changed made here
+/*
+* ISR(PCINT2_vect)
+*
+* Called when a PORTK pin used as CTS changes. Restarts the transmitter of every port whose peer is
+* ready again and that still has data queued.
+*/
+ISR(PCINT2_vect)
+{
+	uint8_t pins = PINK;
+	for (uint8_t port = 0; port < 4; port++)
+	{
+		if (ports[port].cts_mask && !(pins & ports[port].cts_mask) && Q_used(ports[port].tx_qid) > 0)
+		{
+			serial_tx_start(port);
+		}
+	}
+}
 
+/*
+* serial_ubrr
+*
+* Returns the UBRR value (U2X mode, 16 MHz) for the specified baud rate, or -1 if the rate is not supported.
+*
+* @param long speed - baud rate
+* @return long - UBRR value or -1
+*/
+static long serial_ubrr(long speed)
+{
 	long reg_set = -1;
 
 	switch(speed)
@@ -111,13 +352,52 @@ int Serial_open(int port, long speed, int config)
 		break;
 	}
 
-	//Protects from interrupts
-	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	return reg_set;
+}
+
+/*
+* Serial_open
+*
+* Serial_open configures the specified serial port (USART) for operation according the specified baud rate and configuration.
+* It uses Queue functions to allocate a QCB to manage transmit and receive buffers. It initializes the interface between the
+* ISRs (RXC and UDRE) and the queues for the port by initializing the QCB "handles" to be used by the ISRs. The RXCx interrupt is enabled.
+* Serial_open returns 0 for success and -1 if an error occurs (e.g., bad port ID, baud rate, frame parameters or invalid buffer sizes).
+*
+* @param int port - specifies USART 0, 1, 2 or 3. For right now, 0 is the only one active.
+* @param long speed - baud rate
+* @param constant that specifies framing parameters (data bits, parity, stop bits)
+* @return returns 0 for success and -1 if an error occurs
+*/
+int Serial_open(int port, long speed, int config)
+{
+	if (!SERIAL_PORT_VALID(port))
 	{
-		
-		regs[port]->ubrr = reg_set; //Sets the baud rate
-		regs[port]->ucsrc = config; //Sets the data frame structure
-		regs[port]->ucsrb = (1<<RXEN0) | (1<<TXEN0) | (1<<RXCIE0); //Enables RX, TX, and RX interrupt
+		return -1;
+	}
+	//Creates a Rqueue forRX and TX
+	ports[port].rx_qid = Q_create(ports[port].rx_bufsize, ports[port].rx_buffer);
+	ports[port].tx_qid = Q_create(ports[port].tx_bufsize, ports[port].tx_buffer);
+
+	long reg_set = serial_ubrr(speed);
+
+	//Sets the baud rate and data frame structure, then enables RX, TX, and RX interrupt
+	switch(port)
+	{
+		case 0:
+		serial0_setup(reg_set, config);
+		break;
+
+		case 1:
+		serial1_setup(reg_set, config);
+		break;
+
+		case 2:
+		serial2_setup(reg_set, config);
+		break;
+
+		case 3:
+		serial3_setup(reg_set, config);
+		break;
 	}
 	sei(); //Enables global interrupts
 	return 0;
@@ -133,7 +413,28 @@ int Serial_open(int port, long speed, int config)
 */
 void Serial_close(int port)
 {
-	regs[port]->ucsrb = 0;
+	if (!SERIAL_PORT_VALID(port))
+	{
+		return;
+	}
+	switch(port)
+	{
+		case 0:
+		serial0_shutdown();
+		break;
+
+		case 1:
+		serial1_shutdown();
+		break;
+
+		case 2:
+		serial2_shutdown();
+		break;
+
+		case 3:
+		serial3_shutdown();
+		break;
+	}
 	Q_delete(ports[port].rx_qid);
 	Q_delete(ports[port].tx_qid);
 }
@@ -144,13 +445,91 @@ void Serial_close(int port)
 * Returns number of bytes available for reading from the specified serial port.
 *
 * @param int port - the serial port ID.
-* @return int - Number of byte avaible for reading.
+* @return int - Number of byte avaible for reading, or -1 for a bad port ID.
 */
 int Serial_available(int port)
 {
+	if (!SERIAL_PORT_VALID(port))
+	{
+		return -1;
+	}
 	return Q_used(ports[port].rx_qid);
 }
 
+/*
+* Serial_tx_free
+*
+* Returns number of bytes that can be written to the specified serial port without blocking.
+*
+* @param int port - the serial port ID.
+* @return int - Free space in the transmit queue, or -1 for a bad port ID.
+*/
+int Serial_tx_free(int port)
+{
+	if (!SERIAL_PORT_VALID(port))
+	{
+		return -1;
+	}
+	return Q_unused(ports[port].tx_qid);
+}
+
+/*
+* Serial_tx_lock
+*
+* Takes the transmit side of the specified port for the calling thread, parking the thread while another one
+* holds it. Output written in several pieces (a telemetry frame, a reply) stays in one piece on the wire even
+* though a blocking write may park its writer on a full TX queue half way through. The lock nests: every call
+* must be matched by a Serial_tx_unlock. Threads only; ISRs must not write to a locked port.
+*
+* @param int port - the port ID
+* @return int - 0 for success, -1 for a bad port ID
+*/
+int Serial_tx_lock(int port)
+{
+	if (!SERIAL_PORT_VALID(port))
+	{
+		return -1;
+	}
+	//threads only switch at x_yield, so the owner test and the take need no lock of their own
+	while (ports[port].tx_owner && ports[port].tx_owner != x_thread_mask)
+	{
+		ports[port].tx_lock_waiters |= x_thread_mask;
+		x_suspend(x_getTID());
+		x_yield();
+	}
+	ports[port].tx_owner = x_thread_mask;
+	ports[port].tx_depth++;
+	return 0;
+}
+
+/*
+* Serial_tx_unlock
+*
+* Releases one Serial_tx_lock of the calling thread. The last release frees the port and resumes the threads
+* waiting for it.
+*
+* @param int port - the port ID
+*/
+void Serial_tx_unlock(int port)
+{
+	if (!SERIAL_PORT_VALID(port) || ports[port].tx_owner != x_thread_mask)
+	{
+		return;
+	}
+	if (--ports[port].tx_depth == 0)
+	{
+		ports[port].tx_owner = 0;
+		if (ports[port].tx_lock_waiters)
+		{
+			ATOMIC_BLOCK(ATOMIC_RESTORESTATE) //x_resume_mask expects interrupts off
+			{
+				x_resume_mask(ports[port].tx_lock_waiters);
+			}
+			ports[port].tx_lock_waiters = 0;
+		}
+	}
+}
+
 /*
 * Serial_read
 *
@@ -158,17 +537,29 @@ int Serial_available(int port)
 * Note that the return type is int rather then char or an 8-bit type. This allows for the test for -1 to work.
 * Any 8-bit character (including 0xFF) returned as an int (e.g. 0x00FF) will be positive. 
 * You should test for -1 before using the return value as a character.
+* In line mode, reading a line terminator consumes that line, as Serial_read_line would.
 *
 * @param int port - the serial port ID
-* @return data or -1 if queue is empty
+* @return data or -1 if queue is empty or the port ID is bad
 */
 int Serial_read(int port)
 {
 	char qdata = 0;
 	int data;
 
-	if (Q_getc(ports[port].rx_qid, &qdata))
+	if (SERIAL_PORT_VALID(port) && Q_getc(ports[port].rx_qid, &qdata))
 	{
+		if (ports[port].line_mode && (qdata == ports[port].eol[0] || qdata == ports[port].eol[1]))
+		{
+			ATOMIC_BLOCK(ATOMIC_RESTORESTATE) //the terminator counted by the RX ISR is gone
+			{
+				if (ports[port].rx_lines)
+				{
+					ports[port].rx_lines--;
+				}
+			}
+		}
+		serial_rx_drained(port);
 		data = qdata;
 		return data;
 	}
@@ -178,23 +569,108 @@ int Serial_read(int port)
 	}
 }
 
+/*
+* serial_put
+*
+* Common body of Serial_write_buffer and Serial_print_P. Queues data_length bytes read from RAM,
+* or from flash if in_flash is set. See Serial_write_buffer for the blocking behaviour.
+*/
+static int serial_put(int port, const char * data, int data_length, char blocking, char in_flash)
+{
+	if (!SERIAL_PORT_VALID(port))
+	{
+		return -1;
+	}
+
+	uint8_t qid = ports[port].tx_qid;
+	int i = 0;
+	char parked;
+	char next;
+
+	while (i < data_length)
+	{
+		next = in_flash ? pgm_read_byte(data + i) : data[i];
+		if (ports[port].polled)
+		{
+			//polled mode (checked every byte: a parked writer may wake up in it)
+			Serial_write(port, next);
+			i++;
+			continue;
+		}
+		if (Q_putc(qid, next))
+		{
+			i++;
+			continue;
+		}
+		if (!blocking)
+		{
+			break;
+		}
+		//queue is full: start the transmitter and park until the ISR frees space
+		serial_tx_start(port);
+		parked = 0;
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+		{
+			//retry under the lock, so space freed since the failed put is not missed
+			if (Q_putc(qid, next))
+			{
+				i++;
+			}
+			else
+			{
+				ports[port].tx_waiters |= x_thread_mask;
+				x_suspend(x_getTID());
+				parked = 1;
+			}
+		}
+		if (parked)
+		{
+			x_yield();
+		}
+	}
+	if (i > 0)
+	{
+		serial_tx_start(port);
+	}
+	return i;
+}
+
+/*
+* Serial_write_buffer
+*
+* Queues data_length bytes for transmission on the specified port. The data is binary: null bytes are sent.
+* In SERIAL_BLOCKING mode a full TX queue parks the calling thread (x_suspend) until the UDRE ISR has drained
+* half of the queue, so the whole buffer is always sent. In SERIAL_NONBLOCKING mode it stops at the first byte
+* that does not fit. The transmitter is kicked once per call, plus once before each park in blocking mode.
+*
+* @param int port - the port ID
+* @param char * data - the character array to be written
+* @param int data_length - the number of bytes to write
+* @param char blocking - SERIAL_BLOCKING or SERIAL_NONBLOCKING
+* @return int - number of bytes queued, or -1 for a bad port ID
+*/
+int Serial_write_buffer(int port, char * data, int data_length, char blocking)
+{
+	return serial_put(port, data, data_length, blocking, 0);
+}
+
 /*
 * Serial_write_string
 *
-* Writes a string to the serial port one byte at a time.
+* Writes a string to the serial port, blocking until all of it has been queued. Writing stops at
+* a null terminator or after data_length bytes, whichever comes first.
 *
 * @param int port - the port ID
 * @param char * data - the character array to be written
 * @param int data_length - the length of the char array
-* @return int - always returns 1.
+* @return int - number of bytes written, or -1 for a bad port ID
 */
 int Serial_write_string(int port, char * data, int data_length) {
 	int i = 0;
-	while( data[i] != 0x00) {
-		Serial_write(port, data[i]);
+	while (i < data_length && data[i] != 0x00) {
 		i++;
 	}
-	return 1;
+	return Serial_write_buffer(port, data, i, SERIAL_BLOCKING);
 }
 
 /*
@@ -208,14 +684,18 @@ int Serial_write_string(int port, char * data, int data_length) {
 * @return int - 1 if sucessful, 0 if not
 */
 int Serial_read_string(int port, char * data, int data_length) {
-	char latest;
+	int latest;
 	int i = 0;
 
+	if (!SERIAL_PORT_VALID(port)) {
+		return 0;
+	}
+
 	//loop until end of data
 	while (i < data_length) {
 		//get latest character
 		latest = Serial_read(port);
-		if (latest != 0xFF) {
+		if (latest != -1) {
 			if (latest == 0x0D) {
 				//the input has terminated
 				data[i] = 0x00;//null terminate string
@@ -232,138 +712,576 @@ int Serial_read_string(int port, char * data, int data_length) {
 }
 
 /*
-* Serial_write
+* Serial_format_uint
+*
+* Formats an unsigned integer in decimal. Digits are found by repeated subtraction of powers of ten,
+* which is cheaper on the AVR than 16-bit division. No terminator is written.
+*
+* @param char * buf - destination, at least 5 bytes
+* @param unsigned int value - the value to format
+* @return int - number of characters written
+*/
+int Serial_format_uint(char * buf, unsigned int value)
+{
+	static const unsigned int powers[] PROGMEM = {10000, 1000, 100, 10};
+	char *p = buf;
+	char digit;
+
+	for (uint8_t i = 0; i < 4; i++)
+	{
+		unsigned int power = pgm_read_word(&powers[i]);
+		digit = '0';
+		while (value >= power)
+		{
+			value -= power;
+			digit++;
+		}
+		if (digit != '0' || p != buf) //suppress leading zeros
+		{
+			*p++ = digit;
+		}
+	}
+	*p++ = '0' + value;
+	return p - buf;
+}
+
+/*
+* Serial_format_int
+*
+* Formats a signed integer in decimal. No terminator is written.
+*
+* @param char * buf - destination, at least 6 bytes
+* @param int value - the value to format
+* @return int - number of characters written
+*/
+int Serial_format_int(char * buf, int value)
+{
+	if (value < 0)
+	{
+		*buf = '-';
+		return 1 + Serial_format_uint(buf + 1, -(unsigned int) value);
+	}
+	return Serial_format_uint(buf, value);
+}
+
+/*
+* Serial_format_hex
+*
+* Formats an unsigned integer in lower-case hexadecimal without leading zeros. No terminator is written.
+*
+* @param char * buf - destination, at least 4 bytes
+* @param unsigned int value - the value to format
+* @return int - number of characters written
+*/
+int Serial_format_hex(char * buf, unsigned int value)
+{
+	char *p = buf;
+	char nibble;
+
+	for (int8_t shift = 12; shift >= 0; shift -= 4)
+	{
+		nibble = (value >> shift) & 0x0F;
+		if (nibble || p != buf || shift == 0)
+		{
+			*p++ = nibble < 10 ? '0' + nibble : 'a' - 10 + nibble;
+		}
+	}
+	return p - buf;
+}
+
+/*
+* Serial_format_fixed
+*
+* Formats a signed fixed-point value with frac_bits fraction bits (e.g. 4 for 1/16 units) in decimal,
+* rounded to the given number of decimal places (0-4). No terminator is written.
+*
+* @param char * buf - destination, at least 11 bytes
+* @param int value - the fixed-point value
+* @param uint8_t frac_bits - number of fraction bits in value
+* @param uint8_t decimals - number of digits after the decimal point
+* @return int - number of characters written
+*/
+int Serial_format_fixed(char * buf, int value, uint8_t frac_bits, uint8_t decimals)
+{
+	char *p = buf;
+	unsigned int mag = value;
+	unsigned int scale = 1;
+	unsigned int whole;
+	unsigned int frac;
+
+	if (value < 0)
+	{
+		*p++ = '-';
+		mag = -(unsigned int) value;
+	}
+	for (uint8_t i = 0; i < decimals; i++)
+	{
+		scale *= 10;
+	}
+	whole = mag >> frac_bits;
+	frac = (((unsigned long) (mag & ((1u << frac_bits) - 1)) * scale) + ((1u << frac_bits) >> 1)) >> frac_bits;
+	if (frac >= scale) //rounding carried into the whole part
+	{
+		whole++;
+		frac -= scale;
+	}
+	p += Serial_format_uint(p, whole);
+	if (decimals)
+	{
+		*p++ = '.';
+		for (scale /= 10; scale; scale /= 10)
+		{
+			*p++ = '0' + frac / scale;
+			frac %= scale;
+		}
+	}
+	return p - buf;
+}
+
+/*
+* Serial_print_P
+*
+* Writes a null-terminated string stored in flash (PSTR/PROGMEM) straight into the TX queue, blocking
+* until it has all been queued.
+*
+* @param int port - the port ID
+* @param const char * str - flash address of the string
+* @return int - number of bytes written, or -1 for a bad port ID
+*/
+int Serial_print_P(int port, const char * str)
+{
+	return serial_put(port, str, strlen_P(str), SERIAL_BLOCKING, 1);
+}
+
+/*
+* Serial_print_int
+*
+* Writes a signed integer in decimal, blocking until it has been queued.
+*
+* @param int port - the port ID
+* @param int value - the value to print
+* @return int - number of bytes written, or -1 for a bad port ID
+*/
+int Serial_print_int(int port, int value)
+{
+	char digits[6];
+	return serial_put(port, digits, Serial_format_int(digits, value), SERIAL_BLOCKING, 0);
+}
+
+/*
+* Serial_print_uint
+*
+* Writes an unsigned integer in decimal, blocking until it has been queued.
+*
+* @param int port - the port ID
+* @param unsigned int value - the value to print
+* @return int - number of bytes written, or -1 for a bad port ID
+*/
+int Serial_print_uint(int port, unsigned int value)
+{
+	char digits[5];
+	return serial_put(port, digits, Serial_format_uint(digits, value), SERIAL_BLOCKING, 0);
+}
+
+/*
+* Serial_print_hex
+*
+* Writes an unsigned integer in lower-case hexadecimal, blocking until it has been queued.
+*
+* @param int port - the port ID
+* @param unsigned int value - the value to print
+* @return int - number of bytes written, or -1 for a bad port ID
+*/
+int Serial_print_hex(int port, unsigned int value)
+{
+	char digits[4];
+	return serial_put(port, digits, Serial_format_hex(digits, value), SERIAL_BLOCKING, 0);
+}
+
+/*
+* Serial_print_fixed
+*
+* Writes a signed fixed-point value (see Serial_format_fixed), blocking until it has been queued.
+*
+* @param int port - the port ID
+* @param int value - the fixed-point value
+* @param uint8_t frac_bits - number of fraction bits in value
+* @param uint8_t decimals - number of digits after the decimal point (0-4)
+* @return int - number of bytes written, or -1 for a bad port ID
+*/
+int Serial_print_fixed(int port, int value, uint8_t frac_bits, uint8_t decimals)
+{
+	char digits[11];
+	return serial_put(port, digits, Serial_format_fixed(digits, value, frac_bits, decimals), SERIAL_BLOCKING, 0);
+}
+
+/*
+* Serial_set_line_mode
+*
+* Turns the text line discipline of the specified port on or off. In line mode the RX ISR counts complete
+* CR- or LF-terminated lines and wakes threads blocked in Serial_read_line only when one is ready.
+*
+* @param int port - the port ID
+* @param char enable - 1 to enable line mode, 0 to disable it
+*/
+void Serial_set_line_mode(int port, char enable)
+{
+	if (!SERIAL_PORT_VALID(port))
+	{
+		return;
+	}
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		ports[port].line_mode = enable;
+		ports[port].eol[0] = 0x0D;
+		ports[port].eol[1] = 0x0A;
+		ports[port].rx_lines = 0;
+		ports[port].rx_discard = 0;
+	}
+}
+
+/*
+* Serial_set_frame_mode
+*
+* Puts the specified port in line mode with a single frame delimiter byte (0x00 for COBS frames)
+* in place of CR/LF. Serial_read_line then returns one frame per call.
+*
+* @param int port - the port ID
+* @param char delimiter - the byte that ends each frame
+*/
+void Serial_set_frame_mode(int port, char delimiter)
+{
+	if (!SERIAL_PORT_VALID(port))
+	{
+		return;
+	}
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		ports[port].line_mode = 1;
+		ports[port].eol[0] = delimiter;
+		ports[port].eol[1] = delimiter;
+		ports[port].rx_lines = 0;
+		ports[port].rx_discard = 0;
+	}
+}
+
+/*
+* Serial_read_line
+*
+* Reads one line from a port in line mode. The calling thread is parked until the RX ISR has seen a complete
+* line, which is then copied out in a single pass. Either eol byte ends a line (CR, LF and CR/LF in text
+* mode); empty lines are skipped.
+* A line longer than data_length - 1 is consumed but reported as an error. So is a line handed over before its
+* terminator because it filled the RX queue (or reached the watermark under RTS flow control); the RX ISR then
+* drops the rest of it, so its tail is never returned as a line of its own.
 *
-* Writes one data byte to the serial port. This function enables the transmit ISR (UDRIEx = 1) and blocks until the 
-* write to the corresponding queue is successful. The return value is always 1. 
-* 
 * @param int port - the port ID
-* @param char data - the char to be written to the serial port.
-* @return 1 if successful, -1 if not
+* @param char * data - the array to be read into; always null terminated
+* @param int data_length - the length of the char array
+* @return int - 1 if a whole line was read, 0 if it did not fit, -1 for a bad port ID
 */
-int Serial_write(int port, char data)
+int Serial_read_line(int port, char * data, int data_length)
 {
-	if (Q_putc(ports[port].tx_qid, data))
+	if (!SERIAL_PORT_VALID(port))
 	{
-		//regs[port].ucsrb |= (0x1 << 5); //Commented out line
-		regs[port]->ucsrb |= (1<<UDRIE0);
-		//regs[port].ucsra |= (0x1 << 5); //This might be wrong.
-		return 1;
+		return -1;
 	}
-	return -1;
+	uint8_t qid = ports[port].rx_qid;
+	char eol0 = ports[port].eol[0];
+	char eol1 = ports[port].eol[1];
+	char latest;
+	char parked;
+	int i;
 
+	while (1)
+	{
+		//sleep until the RX ISR reports a complete line
+		parked = 0;
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+		{
+			if (ports[port].rx_lines == 0)
+			{
+				ports[port].rx_waiters |= x_thread_mask;
+				x_suspend(x_getTID());
+				parked = 1;
+			}
+		}
+		if (parked)
+		{
+			x_yield();
+			continue;
+		}
+
+		//copy the line out up to its terminator
+		i = 0;
+		latest = 0;
+		while (Q_getc(qid, &latest) && latest != eol0 && latest != eol1)
+		{
+			if (i < data_length - 1)
+			{
+				data[i] = latest;
+			}
+			i++;
+		}
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+		{
+			if (ports[port].rx_lines)
+			{
+				ports[port].rx_lines--;
+			}
+		}
+		serial_rx_drained(port);
+		if (i > 0)
+		{
+			break;
+		}
+	}
+
+	if (i > data_length - 1)
+	{
+		data[data_length - 1] = 0x00;
+		return 0;
+	}
+	data[i] = 0x00;
+	return (latest == eol0 || latest == eol1);
 }
 
 /*
-* ISR(USART0_UDRE_vect)
+* Serial_set_flow_control
+*
+* Enables GPIO-based RTS/CTS hardware flow control on the specified port. Both lines use PORTK pins
+* (Arduino Mega A8-A15), because CTS needs a pin-change interrupt to restart the transmitter. RTS is
+* driven low while the RX queue has room and high above the 3/4 watermark, until readers drain it
+* below 1/4. In line mode a partial line that reaches the watermark is handed to Serial_read_line as
+* overlong, since with RTS high its terminator may never arrive. The UDRE ISR stops sending while CTS is high. Pass SERIAL_NO_FLOW for either pin to
+* leave that direction uncontrolled.
 *
-* Called when UDRIE0 is flagged.
+* @param int port - the port ID
+* @param int8_t rts_bit - PORTK bit (0-7) for RTS, or SERIAL_NO_FLOW
+* @param int8_t cts_bit - PORTK bit (0-7) for CTS, or SERIAL_NO_FLOW
+* @return int - 0 for success, -1 for a bad port ID or pin
 */
-ISR(USART0_UDRE_vect)
+int Serial_set_flow_control(int port, int8_t rts_bit, int8_t cts_bit)
 {
-	char data;
-	if (Q_getc(ports[0].tx_qid, &data))
+	if (!SERIAL_PORT_VALID(port) || rts_bit > 7 || cts_bit > 7)
 	{
-		UDR0 = data;
+		return -1;
 	}
-	else
+	uint8_t rts_mask = (rts_bit < 0) ? 0 : (1 << rts_bit);
+	uint8_t cts_mask = (cts_bit < 0) ? 0 : (1 << cts_bit);
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
 	{
-		regs[0]->ucsrb &= ~(0x1<<UDRIE0);
+		PCMSK2 &= ~ports[port].cts_mask;
+		ports[port].rts_mask = rts_mask;
+		ports[port].cts_mask = cts_mask;
+
+		DDRK |= rts_mask; //RTS is an output, asserted (low) to start
+		PORTK &= ~rts_mask;
+		DDRK &= ~cts_mask; //CTS is an input with pull-up, so a missing peer reads as not ready
+		PORTK |= cts_mask;
+		PCMSK2 |= cts_mask;
+		if (PCMSK2)
+		{
+			PCICR |= (1<<PCIE2);
+		}
+		else
+		{
+			PCICR &= ~(1<<PCIE2);
+		}
 	}
+	return 0;
 }
 
 /*
-* ISR(USART1_UDRE_vect)
+* Serial_get_errors
+*
+* Copies the receive error counters of the specified port.
 *
-* Called when UDRIE1 is flagged.
+* @param int port - the port ID
+* @param SERIAL_ERRORS * errors - destination for the counters
 */
-ISR(USART1_UDRE_vect)
+void Serial_get_errors(int port, SERIAL_ERRORS * errors)
 {
-	char data;
-	if (Q_getc(ports[1].tx_qid, &data))
+	if (!SERIAL_PORT_VALID(port))
 	{
-		UDR1 = data;
+		return;
 	}
-	else
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
 	{
-		regs[1]->ucsrb &= ~(0x1 << 5);
+		*errors = serial_errors[port];
 	}
 }
 
 /*
-* ISR(USART2_UDRE_vect)
+* Serial_clear_errors
+*
+* Resets the receive error counters of the specified port.
 *
-* Called when UDRIE2 is flagged.
+* @param int port - the port ID
 */
-ISR(USART2_UDRE_vect)
+void Serial_clear_errors(int port)
 {
-	char data;
-	if (Q_getc(ports[2].tx_qid, &data))
+	if (!SERIAL_PORT_VALID(port))
 	{
-		UDR2 = data;
+		return;
 	}
-	else
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		serial_errors[port].overrun = 0;
+		serial_errors[port].framing = 0;
+		serial_errors[port].parity = 0;
+		serial_errors[port].dropped = 0;
+	}
+}
+
+/*
+* Serial0_config
+*
+* Configures USART0 for polled, interrupt-free operation (no RXCIE0/UDRIE0). Needs no queues and no ACX
+* kernel, so it can be called before x_init. Any queued output still pending is discarded.
+*
+* @param long speed - baud rate
+* @param int config - constant that specifies framing parameters (data bits, parity, stop bits)
+*/
+void Serial0_config(long speed, int config)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
 	{
-		regs[2]->ucsrb &= ~(0x1 << 5);
+		UCSR0B = 0;
+		UCSR0A |= (1<<U2X0);
+		UBRR0 = serial_ubrr(speed);
+		UCSR0C = config;
+		UCSR0B = (1<<RXEN0) | (1<<TXEN0);
+		ports[0].polled = 1;
 	}
 }
 
 /*
-* ISR(USART3_UDRE_vect)
+* Serial0_set_polled
 *
-* Called when UDRIE3 is flagged.
+* Switches an open USART0 between queued (interrupt-driven) and polled operation at runtime.
+* Entering polled mode masks both USART0 interrupts and first sends whatever is still in the TX
+* queue, so output stays in order. From then on every write (Serial_write, Serial_write_buffer,
+* the print functions) goes straight to the USART, and threads parked on the full TX queue are
+* resumed to finish their writes that way. Bytes already in the RX queue remain readable with
+* Serial_read; RTS is asserted, since polled reads bypass the queue. Leaving polled mode
+* re-enables the RX interrupt, and the UDRE interrupt if output is pending.
+*
+* @param char polled - 1 for polled mode, 0 for queued mode
 */
-ISR(USART3_UDRE_vect)
+void Serial0_set_polled(char polled)
 {
 	char data;
-	if (Q_getc(ports[3].tx_qid, &data))
+
+	if (polled)
 	{
-		UDR3 = data;
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+		{
+			UCSR0B &= ~((1<<RXCIE0) | (1<<UDRIE0));
+			ports[0].polled = 1;
+		}
+		while (Q_getc(ports[0].tx_qid, &data))
+		{
+			serial0_poll_write(data);
+		}
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+		{
+			x_resume_mask(ports[0].tx_waiters);
+			ports[0].tx_waiters = 0;
+			PORTK &= ~ports[0].rts_mask;
+		}
 	}
 	else
 	{
-		regs[3]->ucsrb &= ~(0x1 << 5);
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+		{
+			ports[0].polled = 0;
+			UCSR0B |= (1<<RXCIE0);
+			if (Q_used(ports[0].tx_qid) > 0)
+			{
+				UCSR0B |= (1<<UDRIE0);
+			}
+		}
 	}
 }
 
 /*
-* ISR(USART0_RX_vect)
+* Serial0_poll_write
+*
+* Busy-waits for the USART0 data register to empty and writes one byte. Interrupts stay enabled during
+* the wait; only the final check of UDRE0 and the write are atomic, so it is safe to call while the queued
+* driver is active (the byte is merged into the queued output) and from fault handlers.
 *
-* Called when there is a value in UDR0
+* @param char data - the byte to send
 */
-ISR(USART0_RX_vect)
+void Serial0_poll_write(char data)
 {
-	Q_putc(ports[0].rx_qid, UDR0);
+	serial0_poll_write(data);
 }
 
 /*
-* ISR(USART1_RX_vect)
+* Serial0_poll_read
+*
+* Busy-waits for the next byte on USART0 and returns it. If the RX interrupt is enabled (queued mode)
+* the byte is taken from the RX queue instead, because the ISR will have consumed UDR0. That is done
+* through Serial_read, so line counts and RTS are kept up to date, and the thread yields between tries.
 *
-* Called when there is a value in UDR1
+* @return char - the received byte
 */
-ISR(USART1_RX_vect)
+char Serial0_poll_read()
 {
-	Q_putc(ports[1].rx_qid, UDR1);
+	int data;
+
+	while (1)
+	{
+		if (UCSR0B & (1<<RXCIE0))
+		{
+			data = Serial_read(0);
+			if (data != -1)
+			{
+				return data;
+			}
+			x_yield();
+		}
+		else if (UCSR0A & (1<<RXC0))
+		{
+			return UDR0;
+		}
+	}
 }
 
 /*
-* ISR(USART2_RX_vect)
+* Serial0_poll_print
+*
+* Writes a null-terminated string to USART0 using Serial0_poll_write.
 *
-* Called when there is a value in UDR2
+* @param char * str - the string to send
 */
-ISR(USART2_RX_vect)
+void Serial0_poll_print(char * str)
 {
-	Q_putc(ports[2].rx_qid, UDR2);
+	while (*str)
+	{
+		Serial0_poll_write(*str++);
+	}
 }
 
 /*
-* ISR(USART3_RX_vect)
+* serial_open, serial_read, serial_write
 *
-* Called when there is a value in UDR3
+* Short names for the polled USART0 path.
 */
-ISR(USART3_RX_vect)
+void serial_open(long speed, int config)
 {
-	Q_putc(ports[3].rx_qid, UDR3);
+	Serial0_config(speed, config);
 }
 
+char serial_read()
+{
+	return Serial0_poll_read();
+}
 
+void serial_write(char data)
+{
+	Serial0_poll_write(data);
+}
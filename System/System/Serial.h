@@ -32,15 +32,6 @@
 #define SERIAL_7O2 0x3C
 #define SERIAL_8O2 0x3E
 
-typedef struct {
-	volatile uint8_t ucsra;
-	volatile uint8_t ucsrb;
-	volatile uint8_t ucsrc;
-	volatile uint8_t reserved;
-	volatile uint16_t ubrr;
-	volatile uint8_t udr;
-}SERIAL_PORT_REGS;
-
 typedef struct {
 	uint8_t rx_qid;
 	uint8_t tx_qid;
@@ -48,8 +39,27 @@ typedef struct {
 	int rx_bufsize;
 	char *tx_buffer;
 	int tx_bufsize;
+	uint8_t tx_waiters;	// mask of threads parked until the UDRE ISR frees TX space
+	uint8_t line_mode;	// if set, the RX ISR counts lines ended by either eol byte
+	char eol[2];		// line terminators (CR/LF for text, 0x00 twice for COBS frames)
+	uint8_t rx_lines;	// number of complete lines waiting in the RX queue
+	uint8_t rx_discard;	// set once a partial line was handed over as overlong; the RX ISR drops the rest of it
+	uint8_t rx_waiters;	// mask of threads parked until a complete line arrives
+	uint8_t rts_mask;	// PORTK bit driven as RTS (low = ready to receive), 0 if none
+	uint8_t cts_mask;	// PINK bit read as CTS (low = peer ready), 0 if none
+	uint8_t tx_owner;	// thread mask of the thread holding the TX lock, 0 if free
+	uint8_t tx_depth;	// nested Serial_tx_lock calls of the owner
+	uint8_t tx_lock_waiters;	// mask of threads parked until the TX lock is released
+	uint8_t polled;		// if set, writes bypass the TX queue and UDRE ISR (Serial0_set_polled)
 }SERIAL_PORT;
 
+typedef struct {
+	uint16_t overrun;	// DORn: bytes lost in the USART before the RX ISR ran
+	uint16_t framing;	// FEn: bytes received with a bad stop bit (discarded)
+	uint16_t parity;	// UPEn: bytes received with a parity error (discarded)
+	uint16_t dropped;	// bytes lost because the RX queue was full
+}SERIAL_ERRORS;
+
 
 #define P0_RX_BUFFER_SIZE   64
 #define P0_TX_BUFFER_SIZE   64
@@ -60,6 +70,11 @@ typedef struct {
 #define P3_RX_BUFFER_SIZE   32
 #define P3_TX_BUFFER_SIZE   32
 
+#define SERIAL_NONBLOCKING  0
+#define SERIAL_BLOCKING     1
+
+#define SERIAL_NO_FLOW      -1	// pin argument to Serial_set_flow_control for no RTS or CTS
+
 
 void serial_open(long speed, int config);
 char serial_read();
@@ -69,12 +84,64 @@ int Serial_open(int port, long speed, int config);
 void Serial_close(int);
 void Serial_config(int, long, int);
 int Serial_available(int);
+int Serial_tx_free(int);
+int Serial_tx_lock(int);
+void Serial_tx_unlock(int);
 int Serial_read(int);
-int Serial_write(int, char);
+int Serial0_write(char);
+int Serial1_write(char);
+int Serial2_write(char);
+int Serial3_write(char);
 void Serial0_config(long,int);
+void Serial0_set_polled(char);
 char Serial0_poll_read();
 void Serial0_poll_write(char);
 void Serial0_poll_print(char *);
+int Serial_write_buffer(int port, char * data, int data_length, char blocking);
 int Serial_write_string(int port, char * data, int data_length);
 int Serial_read_string(int port, char * data, int data_length);
+int Serial_format_uint(char * buf, unsigned int value);
+int Serial_format_int(char * buf, int value);
+int Serial_format_hex(char * buf, unsigned int value);
+int Serial_format_fixed(char * buf, int value, uint8_t frac_bits, uint8_t decimals);
+int Serial_print_P(int port, const char * str);
+int Serial_print_int(int port, int value);
+int Serial_print_uint(int port, unsigned int value);
+int Serial_print_hex(int port, unsigned int value);
+int Serial_print_fixed(int port, int value, uint8_t frac_bits, uint8_t decimals);
+void Serial_set_line_mode(int port, char enable);
+void Serial_set_frame_mode(int port, char delimiter);
+int Serial_set_flow_control(int port, int8_t rts_bit, int8_t cts_bit);
+void Serial_get_errors(int port, SERIAL_ERRORS * errors);
+void Serial_clear_errors(int port);
+int Serial_read_line(int port, char * data, int data_length);
+
+/*
+* Serial_write
+*
+* Writes one data byte to the serial port by queueing it and enabling the transmit ISR (UDRIEx = 1).
+* Defined inline so that a call with a constant port folds straight into that port's Serialn_write.
+*
+* @param int port - the port ID
+* @param char data - the char to be written to the serial port.
+* @return 1 if successful, -1 if not
+*/
+static inline int Serial_write(int port, char data)
+{
+	switch(port)
+	{
+		case 0:
+		return Serial0_write(data);
+
+		case 1:
+		return Serial1_write(data);
+
+		case 2:
+		return Serial2_write(data);
+
+		case 3:
+		return Serial3_write(data);
+	}
+	return -1;
+}
 #endif /* SERIAL_H_ */
\ No newline at end of file
@@ -0,0 +1,68 @@
+/*
+ * Snapshot.c
+ *	Seqlock. Writers may be threads or ISRs but must not overlap one another.
+ *  Readers must be threads: a reader that finds a write in progress yields
+ *  to let the writer finish, which an ISR cannot do.
+ *
+ * Created: 10/19/2026
+ */
+
+#include <string.h>
+
+#include "acx.h"
+#include "Snapshot.h"
+
+// Keeps the compiler from moving record accesses across the sequence updates
+#define SNAPSHOT_BARRIER()	__asm__ __volatile__ ("" ::: "memory")
+
+/*
+ * Publishes a new value of the record.
+ *
+ * @param SNAPSHOT * s - the snapshot
+ * @param const void * src - the new record, s->size bytes
+ */
+void snapshot_write(SNAPSHOT *s, const void *src)
+{
+	s->seq++;
+	SNAPSHOT_BARRIER();
+	memcpy(s->data, src, s->size);
+	SNAPSHOT_BARRIER();
+	s->seq++;
+}
+
+/*
+ * Copies out a consistent value of the record.
+ *
+ * @param SNAPSHOT * s - the snapshot
+ * @param void * dst - receives the record, s->size bytes
+ */
+void snapshot_read(SNAPSHOT *s, void *dst)
+{
+	snapshot_read_part(s, 0, s->size, dst);
+}
+
+/*
+ * Copies out a consistent value of part of the record, for a reader that
+ * needs a field or two and has no room for the whole record.
+ *
+ * @param SNAPSHOT * s - the snapshot
+ * @param uint8_t offset - first byte of the part
+ * @param uint8_t size - bytes in the part
+ * @param void * dst - receives the part
+ */
+void snapshot_read_part(SNAPSHOT *s, uint8_t offset, uint8_t size, void *dst)
+{
+	while (1) {
+		uint8_t seq = s->seq;
+		if (seq & 1) {
+			x_yield(); //a thread is mid-write; let it finish
+			continue;
+		}
+		SNAPSHOT_BARRIER();
+		memcpy(dst, (const uint8_t *) s->data + offset, size);
+		SNAPSHOT_BARRIER();
+		if (s->seq == seq) {
+			return;
+		}
+	}
+}
@@ -0,0 +1,33 @@
+/*
+ * Snapshot.h
+ *	Seqlock-protected records shared between threads. A writer publishes a
+ *  whole record at once; a reader copies it out and retries if a write got
+ *  in the way, so it never sees half of one update and half of another, and
+ *  neither side disables interrupts or waits on a lock.
+ *
+ * Created: 10/19/2026
+ */
+
+
+#ifndef SNAPSHOT_H_
+#define SNAPSHOT_H_
+
+#include "System.h"
+
+typedef struct {
+	volatile uint8_t seq;	// bumped before and after each write: odd while one is in progress
+	uint8_t size;			// bytes in the record
+	void *data;				// the record; only touched through snapshot_read/write
+} SNAPSHOT;
+
+// Static initializer for a snapshot guarding record (a variable, not a pointer)
+#define SNAPSHOT_INIT(record)	{0, sizeof(record), &(record)}
+
+//
+// Function Prototypes
+//
+void snapshot_write(SNAPSHOT *, const void *);
+void snapshot_read(SNAPSHOT *, void *);
+void snapshot_read_part(SNAPSHOT *, uint8_t, uint8_t, void *);
+
+#endif /* SNAPSHOT_H_ */
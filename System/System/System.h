@@ -14,6 +14,27 @@
 #define NULL ((void *)0)
 #endif
 
+//CPU clock in Hz. Given without a UL suffix because delay_usec.S uses it too.
+#ifndef F_CPU
+#define F_CPU 16000000
+#endif
+
+/*
+ * 1-Wire bus backend. With OW_USE_USART1 set, the sensors hang off USART1
+ * (TXD1 through an open-drain buffer, RXD1 on the bus) and every reset and bit
+ * slot is timed by the USART; the port is then not available to Serial_open.
+ * With it clear, the bus is bit-banged on PE4.
+ */
+#define OW_USE_USART1 0
+
+/*
+ * Number of thermal zones (boxes) the controller runs, each with its own
+ * sensor, heater and fan outputs (see Pwm.h) and settings. At most
+ * PWM_CHANNELS (8), and no more than OW_MAX_SENSORS (4) so each zone can
+ * have a sensor of its own.
+ */
+#define ZONE_COUNT 1
+
 #ifndef __ASSEMBLER__
 typedef uint8_t byte;
 
@@ -0,0 +1,365 @@
+/*
+ * Telemetry.c
+ *	Binary telemetry protocol. Each packet is a type byte, a payload and a
+ *  CRC16, COBS-encoded so that 0x00 only ever appears as the frame delimiter.
+ *  Frames are streamed straight into the serial TX queue; no frame buffer is kept.
+ *
+ * Created: 10/19/2026
+ */
+
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+#include <util/crc16.h>
+#include <string.h>
+
+#include "System.h"
+#include "Serial.h"
+#include "Telemetry.h"
+
+#define		TLM_BLOCK_MAX		253		// longest text segment sent as one zero-terminated COBS block
+
+/*
+ * CRC of the TLM_TEXT packet being streamed on each port. A packet holds the
+ * port's TX lock from Telemetry_text_begin to Telemetry_text_end, so a port
+ * never has two of them in progress.
+ */
+static uint16_t tlm_text_crc[4];
+
+/*
+ * Returns the CRC16 (CCITT polynomial, reflected, initial value 0xFFFF) of a buffer.
+ * Because no final XOR is applied, the CRC of a packet followed by its own CRC
+ * (little endian) is zero.
+ */
+uint16_t tlm_crc16(const uint8_t *data, int len)
+{
+	uint16_t crc = 0xFFFF;
+	while (len-- > 0)
+	{
+		crc = _crc_ccitt_update(crc, *data++);
+	}
+	return crc;
+}
+
+/*
+ * Decodes a COBS frame of len bytes (delimiter already removed) from src into dst.
+ * Decoding in place (dst == src) is allowed. Returns the decoded length or -1 if
+ * the frame is malformed.
+ */
+int cobs_decode(const uint8_t *src, int len, uint8_t *dst)
+{
+	const uint8_t *end = src + len;
+	uint8_t *out = dst;
+
+	while (src < end)
+	{
+		uint8_t code = *src++;
+		if (code == 0)
+		{
+			return -1;
+		}
+		for (uint8_t i = 1; i < code; i++)
+		{
+			if (src >= end)
+			{
+				return -1;
+			}
+			*out++ = *src++;
+		}
+		if (code != 0xFF && src < end) //Every short block but the last stood for a zero
+		{
+			*out++ = 0;
+		}
+	}
+	return out - dst;
+}
+
+/*
+ * A piece of a packet being streamed; a packet is a list of these
+ * followed by its CRC.
+ */
+typedef struct {
+	const uint8_t *data;
+	int len;
+} TLM_SEGMENT;
+
+/*
+ * Returns byte i of a packet held as segments followed by a CRC tail.
+ */
+static uint8_t tlm_byte(const TLM_SEGMENT *segs, uint8_t nsegs, const uint8_t *tail, int i)
+{
+	for (uint8_t s = 0; s < nsegs; s++)
+	{
+		if (i < segs[s].len)
+		{
+			return segs[s].data[i];
+		}
+		i -= segs[s].len;
+	}
+	return tail[i];
+}
+
+/*
+ * Streams the COBS encoding of the packet segments + CRC tail to the serial port
+ * one block at a time, ending the frame. The port's TX lock is held from the
+ * first code byte to the delimiter, so no other thread's output lands inside
+ * the frame while this one is parked on a full queue. Returns the number of
+ * bytes queued.
+ */
+static int tlm_encode(int port, const TLM_SEGMENT *segs, uint8_t nsegs, uint16_t crc)
+{
+	uint8_t tail[TLM_CRC_SIZE];
+	int total = TLM_CRC_SIZE;
+	int start = 0;
+	int sent = 0;
+	int i;
+
+	tail[0] = crc & 0xFF;
+	tail[1] = crc >> 8;
+	for (i = 0; i < nsegs; i++)
+	{
+		total += segs[i].len;
+	}
+
+	Serial_tx_lock(port);
+
+	while (start <= total)
+	{
+		//Find the run of non-zero bytes (at most 254) that makes up the next block
+		uint8_t run = 0;
+		while (start + run < total && run < 254 && tlm_byte(segs, nsegs, tail, start + run) != 0)
+		{
+			run++;
+		}
+
+		char code = run + 1;
+		sent += Serial_write_buffer(port, &code, 1, SERIAL_BLOCKING);
+		for (i = start; i < start + run; i++)
+		{
+			char data = tlm_byte(segs, nsegs, tail, i);
+			sent += Serial_write_buffer(port, &data, 1, SERIAL_BLOCKING);
+		}
+		//A short block also consumes the zero (or the implicit end) that follows it
+		start += (run == 254) ? run : run + 1;
+	}
+
+	char delim = TLM_FRAME_DELIM;
+	sent += Serial_write_buffer(port, &delim, 1, SERIAL_BLOCKING);
+	Serial_tx_unlock(port);
+	return sent;
+}
+
+/*
+ * Appends a CRC16 to a packet given as segments and sends it as one frame.
+ * Returns the number of bytes queued.
+ */
+static int tlm_send(int port, const TLM_SEGMENT *segs, uint8_t nsegs)
+{
+	uint16_t crc = 0xFFFF;
+
+	for (uint8_t s = 0; s < nsegs; s++)
+	{
+		for (int i = 0; i < segs[s].len; i++)
+		{
+			crc = _crc_ccitt_update(crc, segs[s].data[i]);
+		}
+	}
+	return tlm_encode(port, segs, nsegs, crc);
+}
+
+/*
+ * Sends len non-zero bytes as one COBS block that decodes to the bytes plus a
+ * 0x00, and folds both into the running text CRC.
+ */
+static void tlm_text_block(int port, const char *data, uint8_t len)
+{
+	char code = len + 1;
+	uint16_t crc = tlm_text_crc[port];
+
+	Serial_write_buffer(port, &code, 1, SERIAL_BLOCKING);
+	Serial_write_buffer(port, (char *) data, len, SERIAL_BLOCKING);
+	while (len--)
+	{
+		crc = _crc_ccitt_update(crc, *data++);
+	}
+	tlm_text_crc[port] = _crc_ccitt_update(crc, 0);
+}
+
+/*
+ * Sends one TLM_SAMPLE packet.
+ *
+ * @param int port - the serial port ID
+ * @param unsigned long time - sample time in milliseconds (x_gtime)
+ * @param uint8_t sensor - sensor ID
+ * @param int16_t temp - temperature in 1/16 degree Celsius
+ * @param uint8_t status - TLM_STATUS_* bits
+ * @return int - number of bytes queued
+ */
+int Telemetry_send_sample(int port, unsigned long time, uint8_t sensor, int16_t temp, uint8_t status)
+{
+	uint8_t pkt[TLM_SAMPLE_SIZE];
+
+	pkt[0] = TLM_SAMPLE;
+	pkt[1] = time & 0xFF;
+	pkt[2] = (time >> 8) & 0xFF;
+	pkt[3] = (time >> 16) & 0xFF;
+	pkt[4] = (time >> 24) & 0xFF;
+	pkt[5] = sensor;
+	pkt[6] = temp & 0xFF;
+	pkt[7] = (temp >> 8) & 0xFF;
+	pkt[8] = status;
+
+	TLM_SEGMENT seg = {pkt, TLM_SAMPLE_SIZE};
+	return tlm_send(port, &seg, 1);
+}
+
+/*
+ * Sends one TLM_BATCH packet.
+ *
+ * @param int port - the serial port ID
+ * @param unsigned long time - time of the newest sample in milliseconds (x_gtime)
+ * @param uint8_t sensor - sensor ID
+ * @param uint8_t count - number of samples summarized
+ * @param int16_t min - lowest temperature in 1/16 degree Celsius
+ * @param int16_t max - highest temperature
+ * @param int16_t mean - mean temperature
+ * @param uint8_t status - TLM_STATUS_* bits
+ * @return int - number of bytes queued
+ */
+int Telemetry_send_batch(int port, unsigned long time, uint8_t sensor, uint8_t count, int16_t min, int16_t max, int16_t mean, uint8_t status)
+{
+	uint8_t pkt[TLM_BATCH_SIZE];
+
+	pkt[0] = TLM_BATCH;
+	pkt[1] = time & 0xFF;
+	pkt[2] = (time >> 8) & 0xFF;
+	pkt[3] = (time >> 16) & 0xFF;
+	pkt[4] = (time >> 24) & 0xFF;
+	pkt[5] = sensor;
+	pkt[6] = count;
+	pkt[7] = min & 0xFF;
+	pkt[8] = (min >> 8) & 0xFF;
+	pkt[9] = max & 0xFF;
+	pkt[10] = (max >> 8) & 0xFF;
+	pkt[11] = mean & 0xFF;
+	pkt[12] = (mean >> 8) & 0xFF;
+	pkt[13] = status;
+
+	TLM_SEGMENT seg = {pkt, TLM_BATCH_SIZE};
+	return tlm_send(port, &seg, 1);
+}
+
+/*
+ * Sends one TLM_HISTORY packet of a dump. The samples must not change while
+ * it is sent; callers pass a copy (see history_read).
+ *
+ * @param int port - the serial port ID
+ * @param const uint8_t * samples - count 6-byte samples, oldest first
+ * @param uint8_t count - number of samples, at most TLM_HISTORY_CHUNK
+ * @param uint8_t flags - TLM_HISTORY_* bits
+ * @return int - number of bytes queued
+ */
+int Telemetry_send_history(int port, const uint8_t *samples, uint8_t count, uint8_t flags)
+{
+	uint8_t head[3] = {TLM_HISTORY, flags, count};
+	TLM_SEGMENT segs[2] = {
+		{head, sizeof(head)},
+		{samples, count * TLM_HISTORY_SAMPLE_SIZE}
+	};
+	return tlm_send(port, segs, 2);
+}
+
+/*
+ * Starts streaming a TLM_TEXT packet. The text is written with Telemetry_text_write
+ * and Telemetry_text_write_P, each piece going straight to the TX queue as its own
+ * COBS block, and the packet is closed by Telemetry_text_end. The calling thread
+ * holds the port's TX lock until then, so other output waits for the packet.
+ *
+ * @param int port - the serial port ID
+ */
+void Telemetry_text_begin(int port)
+{
+	char type = TLM_TEXT;
+
+	Serial_tx_lock(port);
+	tlm_text_crc[port] = 0xFFFF;
+	tlm_text_block(port, &type, 1);
+}
+
+/*
+ * Appends len bytes of text (no null bytes) to the TLM_TEXT packet being streamed.
+ *
+ * @param int port - the serial port ID
+ * @param char * data - the text
+ * @param int len - number of bytes
+ */
+void Telemetry_text_write(int port, char *data, int len)
+{
+	while (len > 0)
+	{
+		uint8_t n = (len > TLM_BLOCK_MAX) ? TLM_BLOCK_MAX : len;
+		tlm_text_block(port, data, n);
+		data += n;
+		len -= n;
+	}
+}
+
+/*
+ * Appends a null-terminated flash (PSTR) string to the TLM_TEXT packet being streamed.
+ *
+ * @param int port - the serial port ID
+ * @param const char * str - flash address of the text
+ */
+void Telemetry_text_write_P(int port, const char *str)
+{
+	char chunk[16];
+	int len = strlen_P(str);
+
+	while (len > 0)
+	{
+		uint8_t n = (len > (int) sizeof(chunk)) ? (int) sizeof(chunk) : len;
+		memcpy_P(chunk, str, n);
+		tlm_text_block(port, chunk, n);
+		str += n;
+		len -= n;
+	}
+}
+
+/*
+ * Ends the TLM_TEXT packet being streamed by sending its CRC and the frame delimiter,
+ * and releases the port.
+ *
+ * @param int port - the serial port ID
+ */
+void Telemetry_text_end(int port)
+{
+	tlm_encode(port, NULL, 0, tlm_text_crc[port]);
+	Serial_tx_unlock(port);
+}
+
+/*
+ * Decodes a received COBS frame (null terminated, delimiter removed) holding a
+ * TLM_COMMAND packet and copies its null-terminated command text into command.
+ * The frame buffer is decoded in place.
+ *
+ * @param char * frame - the frame as returned by Serial_read_line in frame mode
+ * @param char * command - destination for the command text
+ * @param int command_len - size of the command array
+ * @return int - 1 if a valid command was decoded, 0 on a framing, CRC or type error
+ */
+int Telemetry_decode_command(char *frame, char *command, int command_len)
+{
+	int len = cobs_decode((uint8_t *) frame, strlen(frame), (uint8_t *) frame);
+
+	if (len < 1 + TLM_CRC_SIZE || tlm_crc16((uint8_t *) frame, len) != 0 || (uint8_t) frame[0] != TLM_COMMAND)
+	{
+		return 0;
+	}
+	len -= 1 + TLM_CRC_SIZE;
+	if (len > command_len - 1)
+	{
+		return 0;
+	}
+	memcpy(command, frame + 1, len);
+	command[len] = 0x00;
+	return 1;
+}
@@ -0,0 +1,92 @@
+/*
+ * Telemetry.h
+ *	Defines the packet layout, constants and function prototypes for the
+ *  binary telemetry protocol: COBS-framed packets protected by a CRC16.
+ *
+ * Created: 10/19/2026
+ */
+
+
+#ifndef TELEMETRY_H_
+#define TELEMETRY_H_
+
+#include <stdint.h>
+
+//
+// Packet types (first byte of every decoded packet)
+//
+#define		TLM_SAMPLE			0x01	// device -> host: one temperature sample
+#define		TLM_TEXT			0x02	// device -> host: text reply to a command; the receiver
+											// ignores the 0x00 bytes separating streamed text pieces
+#define		TLM_HISTORY			0x03	// device -> host: one chunk of a dump of the sample history
+#define		TLM_BATCH			0x04	// device -> host: summary of one sensor's samples over a report period
+#define		TLM_COMMAND			0x80	// host -> device: text command (e.g. "ST25")
+
+//
+// TLM_SAMPLE layout (little endian, CRC16 follows the payload)
+//
+//   [0]    TLM_SAMPLE
+//   [1-4]  sample time, x_gtime() milliseconds
+//   [5]    sensor ID
+//   [6-7]  temperature, signed 1/16 degree Celsius
+//   [8]    status bits (TLM_STATUS_*)
+//
+#define		TLM_SAMPLE_SIZE		9
+
+#define		TLM_STATUS_SERVICE	0x01	// box is in service mode
+#define		TLM_STATUS_LIGHTS	0x02	// heater lamps are on
+#define		TLM_STATUS_FANS		0x04	// fans are on
+
+//
+// TLM_HISTORY layout (little endian, CRC16 follows the payload)
+//
+//   [0]    TLM_HISTORY
+//   [1]    flags (TLM_HISTORY_*)
+//   [2]    number of samples N, at most TLM_HISTORY_CHUNK
+//   [3-]   N samples, oldest first, TLM_HISTORY_SAMPLE_SIZE bytes each:
+//          4-byte x_gtime() milliseconds, int16 temperature in 1/16 degree Celsius
+//
+// A dump is a run of these packets, each with its own CRC, the last one
+// without TLM_HISTORY_MORE. An empty history is one packet with N = 0.
+//
+#define		TLM_HISTORY_SAMPLE_SIZE	6
+#define		TLM_HISTORY_CHUNK		8		// samples per packet
+
+#define		TLM_HISTORY_MORE	0x01	// more packets of this dump follow
+#define		TLM_HISTORY_GAP		0x02	// samples before this packet were overwritten during the dump
+
+//
+// TLM_BATCH layout (little endian, CRC16 follows the payload)
+//
+//   [0]      TLM_BATCH
+//   [1-4]    time of the newest sample, x_gtime() milliseconds
+//   [5]      sensor ID
+//   [6]      number of samples summarized
+//   [7-8]    minimum, signed 1/16 degree Celsius
+//   [9-10]   maximum
+//   [11-12]  mean
+//   [13]     status bits (TLM_STATUS_*)
+//
+#define		TLM_BATCH_SIZE		14
+
+#define		TLM_CRC_SIZE		2
+#define		TLM_FRAME_DELIM		0x00
+
+// Largest COBS frame a TLM_COMMAND packet may occupy on the wire (without delimiter)
+#define		TLM_COMMAND_FRAME_MAX	16
+
+//
+// Function Prototypes
+//
+uint16_t tlm_crc16(const uint8_t *, int);
+int cobs_decode(const uint8_t *, int, uint8_t *);
+int Telemetry_send_sample(int, unsigned long, uint8_t, int16_t, uint8_t);
+int Telemetry_send_batch(int, unsigned long, uint8_t, uint8_t, int16_t, int16_t, int16_t, uint8_t);
+int Telemetry_send_history(int, const uint8_t *, uint8_t, uint8_t);
+void Telemetry_text_begin(int);
+void Telemetry_text_write(int, char *, int);
+void Telemetry_text_write_P(int, const char *);
+void Telemetry_text_end(int);
+int Telemetry_decode_command(char *, char *, int);
+
+#endif /* TELEMETRY_H_ */
@@ -295,7 +295,10 @@ ISR(TIMER0_COMPA_vect)
 ---------------------------------------------------------------------------------------*/
 void x_suspend(byte tid)
 {
-	x_suspend_status |= (1 << tid);
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		x_suspend_status |= (1 << tid);
+	}
 }
 /*--------------------------------------------------------------------------------------
    Function:       x_resume
@@ -310,7 +313,27 @@ void x_suspend(byte tid)
 ---------------------------------------------------------------------------------------*/
 void x_resume(byte tid)
 {
-	x_suspend_status &= ~(1 << tid);
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		x_suspend_status &= ~(1 << tid);
+	}
+}
+/*--------------------------------------------------------------------------------------
+   Function:       x_resume_mask
+
+   Description:    Clears the suspend status bits of every thread set in the mask.
+                   Intended for ISRs that wake the threads parked on a device;
+                   interrupts are already disabled there, so no atomic block is used.
+
+   Input:         mask - thread mask (bit n = thread n)
+   
+   Returns:        none
+   
+
+---------------------------------------------------------------------------------------*/
+void x_resume_mask(byte mask)
+{
+	x_suspend_status &= ~mask;
 }
 /*--------------------------------------------------------------------------------------
    Function:       x_disable
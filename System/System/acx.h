@@ -16,11 +16,11 @@
 
 #define		STACK_CANARY		0xAA
 
-#define		T0_STACK_SIZE		256
+#define		T0_STACK_SIZE		384
 #define		T1_STACK_SIZE		256
-#define		T2_STACK_SIZE		256
+#define		T2_STACK_SIZE		384
 #define		T3_STACK_SIZE		256
-#define		T4_STACK_SIZE		256
+#define		T4_STACK_SIZE		384
 #define		T5_STACK_SIZE		256
 #define		T6_STACK_SIZE		256
 #define		T7_STACK_SIZE		256
@@ -78,15 +78,21 @@ typedef	struct {
 		byte *spBase;
 }STACK_CONTROL;
 
+// Exec state of the running thread (see acx.c)
+extern byte x_thread_id;
+extern byte x_thread_mask;
+
 // ACX Function prototypes
 void	x_init(void);
 void	x_delay(int);
+unsigned long x_gtime(void);
 void	x_schedule(void);
 void x_new(byte, PTHREAD , byte);
 void x_yield(void);
 byte bit2mask8(int);
 void x_suspend(byte);
 void x_resume(byte);
+void x_resume_mask(byte);
 void x_disable(byte);
 void x_enable(byte);
 
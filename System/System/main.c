@@ -5,28 +5,64 @@
  */
 
 #include <avr/io.h>
+#include <avr/pgmspace.h>
 #include <util/delay.h>
+#include <util/atomic.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
-#include <stdio.h>
 #include "System.h"
 #include "Serial.h"
 #include "Queues.h"
 #include "acx.h"
 #include "DS18B20.h"
+#include "Telemetry.h"
+#include "Pid.h"
+#include "Pwm.h"
+#include "History.h"
+#include "Config.h"
+#include "Event.h"
+#include "Filter.h"
+#include "Snapshot.h"
+#include "Control.h"
+
+#if ZONE_COUNT > OW_MAX_SENSORS
+#error "ZONE_COUNT needs a sensor table entry per zone; raise OW_MAX_SENSORS"
+#endif
 
-#define light_bulbs PB5 //Digital pin 11
-#define fans PB4 //Digital pin 11
 /*
- * The most-recently measured temperature in degrees Celsius
+ * Thread stack budget. The stacks are fixed in acx.h and an overflow runs
+ * silently into the next thread's, so the deepest path of each thread is
+ * checked against the ZONE_COUNT built. A command handler holds a whole
+ * CONFIG (14 bytes a zone plus 15) under io_controller's buffers; the
+ * other threads keep their records static or read single fields. Under any
+ * of them a reply (reply_begin, Serial_tx_lock, serial_put and x_yield with
+ * its 18-byte context) takes about STACK_REPLY_BYTES, and an interrupt
+ * taken there STACK_ISR_BYTES more.
  */
-volatile int last_temp = 0;
+#define CONFIG_BYTES		(14 * ZONE_COUNT + 15)	// sizeof(CONFIG), for the preprocessor
+#define STACK_REPLY_BYTES	120
+#define STACK_ISR_BYTES		40
+#define STACK_FRAME_BYTES	64		// a thread's own locals and the calls down to its reply
+
+_Static_assert(sizeof(CONFIG) == CONFIG_BYTES, "CONFIG_BYTES does not match CONFIG");
+
+#if 8 + TLM_COMMAND_FRAME_MAX + CONFIG_BYTES + STACK_FRAME_BYTES + STACK_REPLY_BYTES + STACK_ISR_BYTES > T2_STACK_SIZE
+#error "ZONE_COUNT: a command handler's CONFIG overflows io_controller's stack; raise T2_STACK_SIZE"
+#endif
+#if STACK_FRAME_BYTES + STACK_REPLY_BYTES + STACK_ISR_BYTES > T0_STACK_SIZE
+#error "box_controller's stack too small; raise T0_STACK_SIZE"
+#endif
+#if OW_MAX_SENSORS * 9 + STACK_FRAME_BYTES + STACK_REPLY_BYTES + STACK_ISR_BYTES > T4_STACK_SIZE
+#error "report_controller's batches overflow its stack; raise T4_STACK_SIZE"
+#endif
 
 /*
- * The most-recently requested temperature for the controlled box,
- * in degrees Celsius
+ * Temperatures are held as signed fixed point in 1/16 degree Celsius,
+ * the DS18B20's native format
  */
-volatile int target_temp = 0;
+#define TEMP_FRAC_BITS 4
+#define TEMP_ONE_DEGREE (1 << TEMP_FRAC_BITS)
 
 /*
  * If true, box is in service mode
@@ -34,301 +70,1232 @@ volatile int target_temp = 0;
 volatile char service_mode = 0;
 
 /*
- * Number of milliseconds to wait between temperature sampling.
+ * The operator settings, written by the command handlers and read by every
+ * other thread. Only ever accessed as a whole through get_config/set_config,
+ * so each control decision uses one consistent set. Starts from these
+ * defaults, replaced by the record saved in EEPROM if there is one.
+ */
+CONFIG config_data = {
+	.zone = {
+		[0 ... ZONE_COUNT - 1] = {
+			.target_temp = 0,
+			.over_temp = 80 * TEMP_ONE_DEGREE,
+			.timeout = 300,			// seconds allowed to reach the target temperature
+			.rom = {0}				// sensor table entry <zone>
+		}
+	},
+	.sample_rate = 1000,			// milliseconds between samples
+	.report_rate = 1000,			// milliseconds between reports; samples in between are batched
+	.display_format = 'C',			// 'C' Celsius, 'F' Fahrenheit, 'X' raw hex (Celsius)
+	.resolution = 12,
+	.kp = PID_DEFAULT_KP,
+	.ki = PID_DEFAULT_KI,
+	.kd = PID_DEFAULT_KD,
+	.filter_median = FILTER_DEFAULT_MEDIAN,
+	.filter_alpha = FILTER_DEFAULT_ALPHA
+};
+SNAPSHOT config_snapshot = SNAPSHOT_INIT(config_data);
+
+/*
+ * What the zone controller last did in each zone, published after every round
+ */
+typedef struct {
+	unsigned long time;		// x_gtime() of the reading
+	int16_t temp;			// filtered zone temperature, 1/16 degree Celsius
+	int16_t output;			// PID output, permille (0 in service mode)
+	uint8_t sensor;			// sensor table entry read, ZONE_NO_SENSOR if none
+} ZONE_STATUS;
+
+typedef struct {
+	ZONE_STATUS zone[ZONE_COUNT];
+} STATUS;
+
+#define ZONE_NO_SENSOR	0xFF
+
+STATUS status_data;
+SNAPSHOT status_snapshot = SNAPSHOT_INIT(status_data);
+
+/*
+ * If true, samples and replies are sent as COBS-framed binary telemetry
+ * packets and commands are expected in the same framing.
+ */
+volatile char binary_telemetry = 0;
+
+/*
+ * Set by the RS command; the sensor thread searches the 1-Wire bus again
+ * between samples so the search never interrupts a conversion.
+ */
+volatile char rescan_sensors = 0;
+
+/*
+ * The zone table: the control state of each thermal zone. A zone's
+ * settings are in config.zone[], its outputs on PWM channel <zone>.
+ */
+ZONE zones[ZONE_COUNT];
+
+/*
+ * Bit z set once zone z has been shut down (over-temperature or timeout);
+ * its outputs then stay off until reset.
+ */
+volatile uint8_t zones_shut = 0;
+
+/*
+ * Set by SO for each zone whose timeout starts over
+ */
+volatile uint8_t timeout_restart = 0;
+
+/*
+ * The zone the per-zone commands (ST, OV, SO, GT, TL, TF, ZA) act on, set by ZS
+ */
+uint8_t command_zone = 0;
+
+/*
+ * The sample pipeline. The sensor thread stores each round of readings in
+ * sample and publishes sample_event; the box controller acts on it at once
+ * and publishes control_event; the report thread then sends the results.
+ * Each stage sleeps until its input event fires. Threads only switch at
+ * x_yield/x_delay, so a stage reads sample without it changing underneath.
+ */
+typedef struct {
+	unsigned long time;				// x_gtime() when the readings were taken
+	uint8_t count;					// sensors read
+	uint8_t valid;					// bit i set if temp[i] is a good reading
+	int16_t temp[OW_MAX_SENSORS];	// 1/16 degree Celsius
+} SAMPLE;
+
+SAMPLE sample;
+EVENT sample_event;
+EVENT control_event;
+
+/*
+ * A report is only started with this much room in the TX queue; while
+ * replies or an earlier report hold the port, samples keep accumulating.
+ */
+#define REPORT_TX_FREE 32
+
+/*
+ * Samples of one sensor accumulated for the next report
+ */
+typedef struct {
+	uint8_t count;
+	int16_t min;
+	int16_t max;
+	int32_t sum;
+} BATCH;
+
+/*
+ * Messages sent from more than one place
+ */
+const char msg_service_mode[] PROGMEM = "Entering Service Mode\n\r";
+const char msg_operating_mode[] PROGMEM = "Entering Operating Mode\n\r";
+const char msg_unrecognized[] PROGMEM = "Unrecognized command\n\r";
+
+/*
+ * Consistent copies of the settings and status, and publishing new settings
+ * to every thread (and to EEPROM, in the background).
+ */
+void get_config(CONFIG * c) {
+	snapshot_read(&config_snapshot, c);
+}
+
+void set_config(const CONFIG * c) {
+	snapshot_write(&config_snapshot, c);
+	config_save(c);
+}
+
+void get_status(STATUS * s) {
+	snapshot_read(&status_snapshot, s);
+}
+
+/*
+ * Consistent copies of one field (a zone's settings, say) of the settings or
+ * status, for threads that need only a little of a record
+ */
+#define GET_CONFIG_FIELD(field, dst)	snapshot_read_part(&config_snapshot, offsetof(CONFIG, field), sizeof(config_data.field), (dst))
+#define GET_STATUS_FIELD(field, dst)	snapshot_read_part(&status_snapshot, offsetof(STATUS, field), sizeof(status_data.field), (dst))
+
+/*
+ * Reply helpers. Every message on the command port is built from these pieces,
+ * which go straight into the TX queue (or into a streamed TLM_TEXT packet in
+ * binary mode) without being formatted into a buffer first. Several threads
+ * reply on port 0, so a reply holds the port's TX lock from reply_begin to
+ * reply_end and is never interleaved with another.
+ */
+void reply_begin(void) {
+	Serial_tx_lock(0);
+	if (binary_telemetry) {
+		Telemetry_text_begin(0);
+	}
+}
+
+void reply_end(void) {
+	if (binary_telemetry) {
+		Telemetry_text_end(0);
+	}
+	Serial_tx_unlock(0);
+}
+
+void reply_P(const char * str) {
+	if (binary_telemetry) {
+		Telemetry_text_write_P(0, str);
+	} else {
+		Serial_print_P(0, str);
+	}
+}
+
+void reply_int(int value) {
+	if (binary_telemetry) {
+		char digits[6];
+		Telemetry_text_write(0, digits, Serial_format_int(digits, value));
+	} else {
+		Serial_print_int(0, value);
+	}
+}
+
+void reply_uint(unsigned int value) {
+	if (binary_telemetry) {
+		char digits[5];
+		Telemetry_text_write(0, digits, Serial_format_uint(digits, value));
+	} else {
+		Serial_print_uint(0, value);
+	}
+}
+
+void reply_hex(unsigned int value) {
+	if (binary_telemetry) {
+		char digits[4];
+		Telemetry_text_write(0, digits, Serial_format_hex(digits, value));
+	} else {
+		Serial_print_hex(0, value);
+	}
+}
+
+/*
+ * Fixed-point temperature in 1/16 degree, rounded to two decimals
  */
-volatile unsigned int sample_rate = 1000;
+void reply_fixed(int value) {
+	if (binary_telemetry) {
+		char digits[11];
+		Telemetry_text_write(0, digits, Serial_format_fixed(digits, value, TEMP_FRAC_BITS, 2));
+	} else {
+		Serial_print_fixed(0, value, TEMP_FRAC_BITS, 2);
+	}
+}
 
 /*
- * If true, current reporting mode is celsius, otherwise Fahrenheit.
+ * Send a complete reply stored in flash.
  */
-volatile char celsius = 1;
+void reply_line_P(const char * str) {
+	reply_begin();
+	reply_P(str);
+	reply_end();
+}
 
 /*
- * The over-temperature set point in celsius
+ * A temperature in the current display format, without its unit
  */
-volatile int over_temp = 80;
+void reply_temp_value(int temp, char format) {
+	switch (format) {
+		case 'F':
+			//(9/5)*C + 32, still in 1/16 degree
+			reply_fixed((temp + (temp << 3))/5 + 32 * TEMP_ONE_DEGREE);
+			break;
+		case 'X':
+			reply_hex(temp);
+			break;
+		default:
+			reply_fixed(temp);
+			break;
+	}
+}
 
 /*
-* Number of seconds allowed to reach target temperature.
-*/
-volatile int timeout = 300;
+ * The unit of the current display format, ending the line
+ */
+void reply_temp_unit(char format) {
+	switch (format) {
+		case 'F':
+			reply_P(PSTR(" degrees Fahrenheit\n\r"));
+			break;
+		case 'X':
+			reply_P(PSTR(" raw hex\n\r"));
+			break;
+		default:
+			reply_P(PSTR(" degrees Celsius\n\r"));
+			break;
+	}
+}
 
 /*
- * The format used for all temperature reading output.
+ * "Zone N: " in front of a per-zone message, when there is more than one zone
  */
-char * format = "Last temp: %d degrees Celsius\n\r";
+void reply_zone(uint8_t zone) {
+#if ZONE_COUNT > 1
+	reply_P(PSTR("Zone "));
+	reply_uint(zone);
+	reply_P(PSTR(": "));
+#endif
+}
 
 /*
- * Permanently shut down the system.
+ * Send "Last temp: ..." for a zone in the given display format, taken by the
+ * caller from the same settings it is replying under.
  */
-void shut_down(void) {
-	PORTB |= (0x1 << light_bulbs) | (0x1 << fans);
-	x_disable(1);
-	x_disable(0);
+void reply_temp(uint8_t zone, int temp, char format) {
+	reply_begin();
+	reply_zone(zone);
+	reply_P(PSTR("Last temp: "));
+	reply_temp_value(temp, format);
+	reply_temp_unit(format);
+	reply_end();
+}
 
+/*
+ * Collect the TLM_STATUS_* bits for a telemetry sample.
+ */
+uint8_t telemetry_status(uint8_t zone) {
+	uint8_t status = 0;
+	if (service_mode) {
+		status |= TLM_STATUS_SERVICE;
+	}
+	if (pwm_heater(zone)) {
+		status |= TLM_STATUS_LIGHTS;
+	}
+	if (pwm_fan(zone)) {
+		status |= TLM_STATUS_FANS;
+	}
+	return status;
 }
 
 /*
- * Reverse the effects of shut down.
+ * Permanently shut down one zone, saying why.
  */
-void start_up(void) {
-	PORTB |= ~(0x1 << fans);
-	x_enable(0);
-	x_enable(1);
+void shut_down(uint8_t zone, const char * why) {
+	pwm_set_heater(zone, 0);
+	pwm_set_fan(zone, 0);
+	zones_shut |= 1 << zone;
+	reply_begin();
+	reply_zone(zone);
+	reply_P(why);
+	reply_end();
 }
 
 /*
- * Periodically check for abort condition
+ * Periodically check each zone for abort condition: a zone still more than
+ * a degree short of its target when its timeout runs out is shut down.
  */
 void timeout_controller(void) {
+	uint16_t elapsed[ZONE_COUNT];
+	CONFIG_ZONE cz;
+	int16_t temp;
+
+	memset(elapsed, 0, sizeof(elapsed));
 	while(1) {
-		/*
-		* As a workaround for the maxiumum number of milliseconds,
-		* we x_delay for every second in the global timeout variable.
-		*/
-		for (int i = 0; i < timeout; i++) {
-			x_delay(1000);
+		x_delay(1000);
+		for (uint8_t z = 0; z < ZONE_COUNT; z++) {
+			if (timeout_restart & (1 << z)) {
+				timeout_restart &= ~(1 << z);
+				elapsed[z] = 0;
+			}
+			//only the zone's own settings and temperature, not whole records
+			GET_CONFIG_FIELD(zone[z], &cz);
+			if ((zones_shut & (1 << z)) || ++elapsed[z] < cz.timeout) {
+				continue;
+			}
+			elapsed[z] = 0;
+			GET_STATUS_FIELD(zone[z].temp, &temp);
+			if (temp < cz.target_temp - TEMP_ONE_DEGREE) {
+				shut_down(z, PSTR("Timeout occurred; Shutting down.\n\r"));
+			}
+		}
+	}
+}
+
+/************************************************************************/
+/* Command handlers. Each takes the operand parsed as its table entry  */
+/* says (CMD_ARG_*) and sends its own reply.                            */
+/************************************************************************/
+
+/*
+ * SM - Enter Service Mode
+ */
+void cmd_service_mode(int arg) {
+	reply_line_P(msg_service_mode);
+	service_mode = 1;
+}
+
+/*
+ * TM - Toggle Modes
+ */
+void cmd_toggle_mode(int arg) {
+	service_mode = !service_mode;
+	if (service_mode) {
+		reply_line_P(msg_service_mode);
+	} else {
+		reply_line_P(msg_operating_mode);
+	}
+}
+
+/*
+ * OM - Enter Operating Mode
+ */
+void cmd_operating_mode(int arg) {
+	reply_line_P(msg_operating_mode);
+	service_mode = 0;
+}
+
+/*
+ * BT_ - Binary Telemetry
+ * Expects 1 to switch to COBS-framed binary packets, 0 for text.
+ * The reply is sent in the old framing, then the port is switched.
+ */
+void cmd_binary_telemetry(int arg) {
+	if (arg == '1') {
+		reply_line_P(PSTR("Binary telemetry on\n\r"));
+		binary_telemetry = 1;
+		Serial_set_frame_mode(0, TLM_FRAME_DELIM);
+	} else {
+		reply_line_P(PSTR("Binary telemetry off\n\r"));
+		binary_telemetry = 0;
+		Serial_set_line_mode(0, 1);
+	}
+}
+
+/*
+ * GT - Get current Temperature
+ */
+void cmd_get_temp(int arg) {
+	int16_t temp;
+	char format;
+	GET_STATUS_FIELD(zone[command_zone].temp, &temp);
+	GET_CONFIG_FIELD(display_format, &format);
+	reply_temp(command_zone, temp, format);
+}
+
+/*
+ * OV#+ - set maximum allowed temperature before shutdown
+ * Expects a 1-3 digit temperature in Celsius
+ */
+void cmd_over_temp(int arg) {
+	CONFIG c;
+	get_config(&c);
+	c.zone[command_zone].over_temp = arg * TEMP_ONE_DEGREE;
+	set_config(&c);
+	reply_begin();
+	reply_zone(command_zone);
+	reply_P(PSTR("Over-temperature set to "));
+	reply_int(arg);
+	reply_P(PSTR(" degrees Celsius\n\r"));
+	reply_end();
+}
+
+/*
+ * SO#+ - set the timeOut
+ * Expects a 1-3 digit number of minutes to attempt to reach
+ * target temperature before shutting down.
+ */
+void cmd_timeout(int arg) {
+	CONFIG c;
+	get_config(&c);
+	c.zone[command_zone].timeout = arg * 60;
+	set_config(&c);
+	reply_begin();
+	reply_zone(command_zone);
+	reply_P(PSTR("Timeout set to "));
+	reply_uint(c.zone[command_zone].timeout);
+	reply_P(PSTR(" seconds\n\r"));
+	reply_end();
+	timeout_restart |= 1 << command_zone; //kick off the timeout
+}
+
+/*
+ * GE - Get Errors: serial receive errors on the command port
+ * and sensor read errors on the 1-Wire bus
+ */
+void cmd_get_errors(int arg) {
+	SERIAL_ERRORS errors;
+	Serial_get_errors(0, &errors);
+	reply_begin();
+	reply_P(PSTR("Overrun "));
+	reply_uint(errors.overrun);
+	reply_P(PSTR(", framing "));
+	reply_uint(errors.framing);
+	reply_P(PSTR(", parity "));
+	reply_uint(errors.parity);
+	reply_P(PSTR(", dropped "));
+	reply_uint(errors.dropped);
+	reply_P(PSTR("\n\rSensor CRC "));
+	reply_uint(ow_errors.crc);
+	reply_P(PSTR(", retries "));
+	reply_uint(ow_errors.retries);
+	reply_P(PSTR(", failed "));
+	reply_uint(ow_errors.failed);
+	reply_P(PSTR(", timeouts "));
+	reply_uint(ow_errors.timeouts);
+	reply_P(PSTR("\n\r"));
+	reply_end();
+}
+
+/*
+ * CK_ - Check sensor CRCs
+ * Expects 1 to read and verify the whole scratchpad, 0 for
+ * fast reads of the two temperature bytes only.
+ */
+void cmd_check_crc(int arg) {
+	ow_check_crc = (arg != '0');
+	if (ow_check_crc) {
+		reply_line_P(PSTR("Sensor CRC checking on\n\r"));
+	} else {
+		reply_line_P(PSTR("Sensor CRC checking off\n\r"));
+	}
+}
+
+/*
+ * TL - Toogle Lights
+ */
+void cmd_toggle_lights(int arg) {
+	pwm_set_heater(command_zone, pwm_heater(command_zone) ? 0 : PWM_MAX);
+	reply_begin();
+	reply_zone(command_zone);
+	reply_P(PSTR("Toggling Lights\n\r"));
+	reply_end();
+}
+
+/*
+ * TF - Toggle fans
+ */
+void cmd_toggle_fans(int arg) {
+	pwm_set_fan(command_zone, pwm_fan(command_zone) ? 0 : PWM_MAX);
+	reply_begin();
+	reply_zone(command_zone);
+	reply_P(PSTR("Toggling Fans\n\r"));
+	reply_end();
+}
+
+/*
+ * RS - Rescan the 1-Wire bus for sensors
+ */
+void cmd_rescan(int arg) {
+	rescan_sensors = 1;
+	reply_line_P(PSTR("Rescanning sensors\n\r"));
+}
+
+/*
+ * RE#+ - set sensor REsolution
+ * Expects 9-12 bits; 9 bits converts in 94ms, 12 bits in 750ms.
+ */
+void cmd_resolution(int arg) {
+	CONFIG c;
+	if (arg < 9 || arg > 12) {
+		reply_line_P(PSTR("Invalid resolution.\n\r"));
+		return;
+	}
+	get_config(&c);
+	c.resolution = arg;
+	set_config(&c);
+	reply_begin();
+	reply_P(PSTR("Resolution set to "));
+	reply_int(arg);
+	reply_P(PSTR(" bits\n\r"));
+	reply_end();
+}
+
+/*
+ * ST#+ - Set Target temperature
+ * Expects a 1-3 digit Celsius temperature as the target.
+ */
+void cmd_target_temp(int arg) {
+	CONFIG c;
+	if (arg < 0 || arg > 125) {
+		reply_line_P(PSTR("Invalid temperature selection.\n\r"));
+		return;
+	}
+	get_config(&c);
+	c.zone[command_zone].target_temp = arg * TEMP_ONE_DEGREE;
+	set_config(&c);
+	reply_begin();
+	reply_zone(command_zone);
+	reply_P(PSTR("Set target temperature to "));
+	reply_int(arg);
+	reply_P(PSTR(" degrees Celsius\n\r"));
+	reply_end();
+}
+
+/*
+ * SR#+ - Set sample rate
+ * Expects a 1-5 digit sample rate in milliseconds.
+ */
+void cmd_sample_rate(int arg) {
+	CONFIG c;
+	get_config(&c);
+	c.sample_rate = arg;
+	set_config(&c);
+	reply_begin();
+	reply_P(PSTR("Set sample rate to "));
+	reply_uint(c.sample_rate);
+	reply_P(PSTR("\n\r"));
+	reply_end();
+}
+
+/*
+ * RR#+ - set the Report Rate
+ * Expects a 1-5 digit report period in milliseconds; samples taken
+ * in between are summarized in one report.
+ */
+void cmd_report_rate(int arg) {
+	CONFIG c;
+	get_config(&c);
+	c.report_rate = arg;
+	set_config(&c);
+	reply_begin();
+	reply_P(PSTR("Set report rate to "));
+	reply_uint(c.report_rate);
+	reply_P(PSTR("\n\r"));
+	reply_end();
+}
+
+/*
+ * SD_ - Set Display format
+ * Expects a character indicating the desired display format.
+ *   C - Degrees Celsius
+ *	 F - Degrees Fahrenheit
+ *   X - Hexadecimal number, still Degrees Celsius
+ */
+void cmd_display_format(int arg) {
+	CONFIG c;
+	switch (arg) {
+		case 'F':
+			reply_line_P(PSTR("Set format to Fahrenheit\n\r"));
+			break;
+		case 'C':
+			reply_line_P(PSTR("Set format to Celsius\n\r"));
+			break;
+		case 'X':
+			reply_line_P(PSTR("Set format to Celsius Hexadecimal\n\r"));
+			break;
+		default:
+			reply_line_P(PSTR("Unrecognized format\n\r"));
+			return;
+	}
+	get_config(&c);
+	c.display_format = arg;
+	set_config(&c);
+}
+
+/*
+ * Reply "<name> set to <gain>" for the gain commands.
+ */
+void reply_gain(const char * name, int16_t gain) {
+	reply_begin();
+	reply_P(name);
+	reply_P(PSTR(" set to "));
+	reply_fixed(gain);
+	reply_P(PSTR("\n\r"));
+	reply_end();
+}
+
+/*
+ * Kx#+ - set the PID gains (KP, KI, KD)
+ * Expects the gain in 1/16 permille of output per degree Celsius
+ * (per degree-sample for KI, per degree/sample for KD).
+ * The box controller picks them up before its next step.
+ */
+void cmd_gain_p(int arg) {
+	CONFIG c;
+	get_config(&c);
+	c.kp = arg;
+	set_config(&c);
+	reply_gain(PSTR("Kp"), arg);
+}
+
+void cmd_gain_i(int arg) {
+	CONFIG c;
+	get_config(&c);
+	c.ki = arg;
+	set_config(&c);
+	reply_gain(PSTR("Ki"), arg);
+}
+
+void cmd_gain_d(int arg) {
+	CONFIG c;
+	get_config(&c);
+	c.kd = arg;
+	set_config(&c);
+	reply_gain(PSTR("Kd"), arg);
+}
+
+/*
+ * HD - History Dump
+ * Sends every held sample, oldest first: TLM_HISTORY packets of up to
+ * TLM_HISTORY_CHUNK samples in binary mode, otherwise one line per sample
+ * with its age in seconds. The dump yields while the TX queue drains, so it
+ * copies the ring a chunk at a time; samples added meanwhile are left for the
+ * next dump, and ones overwritten before their chunk was copied are skipped.
+ */
+void cmd_history_dump(int arg) {
+	HISTORY_SAMPLE chunk[TLM_HISTORY_CHUNK];
+	uint8_t count = history_count();
+	uint16_t end = history_end();
+	uint16_t seq = end - count;
+	uint16_t sent = 0;
+	uint8_t n;
+
+	if (binary_telemetry) {
+		do {
+			uint16_t from = seq;
+			n = history_read(&seq, end, chunk, TLM_HISTORY_CHUNK);
+			uint8_t flags = ((uint16_t) (seq - n) != from) ? TLM_HISTORY_GAP : 0;
+			if (seq != end) {
+				flags |= TLM_HISTORY_MORE;
+			}
+			Telemetry_send_history(0, (const uint8_t *) chunk, n, flags);
+		} while (seq != end);
+		return;
+	}
+	unsigned long now = x_gtime();
+	reply_begin();
+	reply_uint(count);
+	reply_P(PSTR(" samples, age (s) and degrees Celsius\n\r"));
+	while ((n = history_read(&seq, end, chunk, TLM_HISTORY_CHUNK)) != 0) {
+		for (uint8_t i = 0; i < n; i++) {
+			unsigned long age = (now - chunk[i].time) / 1000;
+			reply_uint(age > 0xFFFF ? 0xFFFF : age);
+			reply_P(PSTR(" "));
+			reply_fixed(chunk[i].temp);
+			reply_P(PSTR("\n\r"));
 		}
-		if (last_temp < target_temp-1) {
-			char * message = "Timeout occurred; Shutting down.\n\r";
-			Serial_write_string(0, message, strlen(message));
-			shut_down();
-			x_disable(3);
+		sent += n;
+	}
+	if (sent != count) {
+		reply_uint(count - sent);
+		reply_P(PSTR(" overwritten during the dump\n\r"));
+	}
+	reply_end();
+}
+
+/*
+ * HS - History Statistics over the window
+ */
+void cmd_history_stats(int arg) {
+	HISTORY_STATS stats;
+	history_stats(&stats);
+	reply_begin();
+	reply_P(PSTR("Last "));
+	reply_uint(stats.count);
+	reply_P(PSTR(" samples: min "));
+	reply_fixed(stats.min);
+	reply_P(PSTR(", max "));
+	reply_fixed(stats.max);
+	reply_P(PSTR(", mean "));
+	reply_fixed(stats.mean);
+	reply_P(PSTR(", std dev "));
+	reply_fixed(stats.stddev);
+	reply_P(PSTR("\n\r"));
+	reply_end();
+}
+
+/*
+ * HW#+ - set the History statistics Window
+ * Expects a window of 1-128 samples.
+ */
+void cmd_history_window(int arg) {
+	if (arg < 1 || arg > HISTORY_SIZE || !history_set_window(arg)) {
+		reply_line_P(PSTR("Invalid window.\n\r"));
+		return;
+	}
+	reply_begin();
+	reply_P(PSTR("Statistics window set to "));
+	reply_uint(arg);
+	reply_P(PSTR(" samples\n\r"));
+	reply_end();
+}
+
+/*
+ * FM#+ - set the Filter Median window
+ * Expects an odd number of samples, 1-9; 1 turns spike rejection off.
+ */
+void cmd_filter_median(int arg) {
+	CONFIG c;
+	if (arg < 1 || arg > FILTER_MEDIAN_MAX || !(arg & 1)) {
+		reply_line_P(PSTR("Invalid median window.\n\r"));
+		return;
+	}
+	get_config(&c);
+	c.filter_median = arg;
+	set_config(&c);
+	reply_begin();
+	reply_P(PSTR("Median window set to "));
+	reply_uint(arg);
+	reply_P(PSTR(" samples\n\r"));
+	reply_end();
+}
+
+/*
+ * FE#+ - set the Filter EMA weight
+ * Expects the weight of each new sample in 1/256, 1-256; 256 turns smoothing off.
+ */
+void cmd_filter_ema(int arg) {
+	CONFIG c;
+	if (arg < 1 || arg > FILTER_ALPHA_ONE) {
+		reply_line_P(PSTR("Invalid EMA weight.\n\r"));
+		return;
+	}
+	get_config(&c);
+	c.filter_alpha = arg;
+	set_config(&c);
+	reply_begin();
+	reply_P(PSTR("EMA weight set to "));
+	reply_uint(arg);
+	reply_P(PSTR("/256\n\r"));
+	reply_end();
+}
+
+/*
+ * ZS#+ - Zone Select
+ * Expects a zone number; ST, OV, SO, GT, TL, TF and ZA then act on that zone.
+ */
+void cmd_zone_select(int arg) {
+	if (arg < 0 || arg >= ZONE_COUNT) {
+		reply_line_P(PSTR("Invalid zone.\n\r"));
+		return;
+	}
+	command_zone = arg;
+	reply_begin();
+	reply_P(PSTR("Zone "));
+	reply_uint(arg);
+	reply_P(PSTR(" selected\n\r"));
+	reply_end();
+}
+
+/*
+ * ZA#+ - Zone Assign sensor
+ * Expects a sensor table entry (0 is the first sensor found); the selected
+ * zone follows that sensor's ROM ID from then on, even after a rescan.
+ */
+void cmd_zone_assign(int arg) {
+	CONFIG c;
+	if (arg < 0 || arg >= ow_sensor_count) {
+		reply_line_P(PSTR("Invalid sensor.\n\r"));
+		return;
+	}
+	get_config(&c);
+	memcpy(c.zone[command_zone].rom, ow_sensors[arg].rom, 8);
+	set_config(&c);
+	reply_begin();
+	reply_zone(command_zone);
+	reply_P(PSTR("Sensor ROM "));
+	for (uint8_t i = 8; i > 0; i--) {
+		uint8_t b = ow_sensors[arg].rom[i - 1];
+		if (b < 0x10) {
+			reply_P(PSTR("0"));
 		}
+		reply_hex(b);
+	}
+	reply_P(PSTR(" assigned\n\r"));
+	reply_end();
+}
+
+/************************************************************************/
+/* Command table                                                        */
+/************************************************************************/
+
+/*
+ * Modes a command is accepted in
+ */
+#define CMD_OPERATING	0x01
+#define CMD_SERVICE		0x02
+#define CMD_ANY			(CMD_OPERATING | CMD_SERVICE)
+
+/*
+ * How the text after the opcode is handed to the handler
+ */
+#define CMD_ARG_NONE	0	// 0
+#define CMD_ARG_INT		1	// atoi of the operand
+#define CMD_ARG_CHAR	2	// first operand character (0 if none)
+
+/*
+ * Every command: X(first opcode char, second opcode char, modes, argument, handler).
+ */
+#define COMMAND_LIST(X) \
+	X('S', 'M', CMD_ANY,       CMD_ARG_NONE, cmd_service_mode) \
+	X('T', 'M', CMD_ANY,       CMD_ARG_NONE, cmd_toggle_mode) \
+	X('O', 'M', CMD_ANY,       CMD_ARG_NONE, cmd_operating_mode) \
+	X('B', 'T', CMD_ANY,       CMD_ARG_CHAR, cmd_binary_telemetry) \
+	X('G', 'T', CMD_SERVICE,   CMD_ARG_NONE, cmd_get_temp) \
+	X('O', 'V', CMD_SERVICE,   CMD_ARG_INT,  cmd_over_temp) \
+	X('S', 'O', CMD_SERVICE,   CMD_ARG_INT,  cmd_timeout) \
+	X('G', 'E', CMD_SERVICE,   CMD_ARG_NONE, cmd_get_errors) \
+	X('C', 'K', CMD_SERVICE,   CMD_ARG_CHAR, cmd_check_crc) \
+	X('T', 'L', CMD_SERVICE,   CMD_ARG_NONE, cmd_toggle_lights) \
+	X('T', 'F', CMD_SERVICE,   CMD_ARG_NONE, cmd_toggle_fans) \
+	X('R', 'S', CMD_SERVICE,   CMD_ARG_NONE, cmd_rescan) \
+	X('R', 'E', CMD_SERVICE,   CMD_ARG_INT,  cmd_resolution) \
+	X('K', 'P', CMD_SERVICE,   CMD_ARG_INT,  cmd_gain_p) \
+	X('K', 'I', CMD_SERVICE,   CMD_ARG_INT,  cmd_gain_i) \
+	X('K', 'D', CMD_SERVICE,   CMD_ARG_INT,  cmd_gain_d) \
+	X('H', 'D', CMD_ANY,       CMD_ARG_NONE, cmd_history_dump) \
+	X('H', 'S', CMD_ANY,       CMD_ARG_NONE, cmd_history_stats) \
+	X('H', 'W', CMD_ANY,       CMD_ARG_INT,  cmd_history_window) \
+	X('F', 'M', CMD_SERVICE,   CMD_ARG_INT,  cmd_filter_median) \
+	X('F', 'E', CMD_SERVICE,   CMD_ARG_INT,  cmd_filter_ema) \
+	X('Z', 'S', CMD_ANY,       CMD_ARG_INT,  cmd_zone_select) \
+	X('Z', 'A', CMD_SERVICE,   CMD_ARG_INT,  cmd_zone_assign) \
+	X('S', 'T', CMD_OPERATING, CMD_ARG_INT,  cmd_target_temp) \
+	X('S', 'R', CMD_OPERATING, CMD_ARG_INT,  cmd_sample_rate) \
+	X('R', 'R', CMD_OPERATING, CMD_ARG_INT,  cmd_report_rate) \
+	X('S', 'D', CMD_OPERATING, CMD_ARG_CHAR, cmd_display_format)
+
+/*
+ * The two opcode characters packed into 16 bits, and the table slot
+ * they hash to. The hash is perfect for the commands above; a new
+ * command that collides fails to compile (see command_slots_unique),
+ * in which case pick another CMD_SLOT multiplier or table size.
+ */
+#define CMD_OPCODE(a, b)	((uint16_t) ((a) << 8 | (b)))
+#define CMD_SLOTS			64
+#define CMD_SLOT(a, b)		((((a) << 1) ^ (b)) & (CMD_SLOTS - 1))
+
+typedef struct {
+	uint16_t opcode;		// CMD_OPCODE, 0 for an empty slot
+	uint8_t modes;			// CMD_OPERATING and/or CMD_SERVICE
+	uint8_t arg;			// CMD_ARG_*
+	void (*handler)(int);
+} COMMAND;
+
+#define CMD_ENTRY(a, b, modes, arg, handler) \
+	[CMD_SLOT(a, b)] = {CMD_OPCODE(a, b), modes, arg, handler},
+const COMMAND commands[CMD_SLOTS] PROGMEM = {
+	COMMAND_LIST(CMD_ENTRY)
+};
+
+/*
+ * Never called: two commands sharing a slot make duplicate case labels,
+ * which is a compile error rather than a silently overwritten entry.
+ */
+#define CMD_CASE(a, b, modes, arg, handler) case CMD_SLOT(a, b):
+static inline void command_slots_unique(uint8_t slot) {
+	switch (slot) {
+		COMMAND_LIST(CMD_CASE)
+		break;
 	}
 }
 
+/*
+ * Look up and run one command line. The opcode picks one table slot,
+ * so every command costs the same single comparison however many exist.
+ */
+void run_command(char * command) {
+	COMMAND entry;
+	char c0 = command[0];
+	char c1 = c0 ? command[1] : 0; //never read past the terminator of a short command
+	char * operand = command + (c0 != 0) + (c1 != 0);
+	uint8_t mode = service_mode ? CMD_SERVICE : CMD_OPERATING;
+	int arg = 0;
+
+	memcpy_P(&entry, &commands[CMD_SLOT(c0, c1)], sizeof(entry));
+	if (entry.opcode != CMD_OPCODE(c0, c1) || !entry.handler || !(entry.modes & mode)) {
+		/*
+		 * Catch-all: the user has entered an opcode that is not valid
+		 * in the current mode.
+		 */
+		reply_line_P(msg_unrecognized);
+		return;
+	}
+	switch (entry.arg) {
+		case CMD_ARG_INT:
+			arg = atoi(operand);
+			break;
+		case CMD_ARG_CHAR:
+			arg = operand[0];
+			break;
+	}
+	entry.handler(arg);
+}
+
 /*
  * Handles serial I/O
  */
 void io_controller(void) {
 	Serial_open(0,19200,SERIAL_8N1); //prepare serial communications
+	Serial_set_line_mode(0, 1); //wake this thread once per complete command
 
 	/*
 	 * These variables are used for processing input instructions
 	 */
 	int command_len = 8;
-	int opcode_len = 2;
-	int operand_len = 6;
 	char command[command_len];
-	char opcode[opcode_len];
-	char operand[operand_len];
+	char frame[TLM_COMMAND_FRAME_MAX];
 
-	/*
-	 * These variables are used for output
-	 */
-	char message[64];
-	char * str;
-	char * formatStr;
-	
 	while(1) {
 		//if we are able to read a command
-		if(Serial_read_string(0,command,command_len)) {
-			//extract the two-character opcode
-			opcode[0] = command[0];
-			opcode[1] = command[1];
-
-			//extract a numeric operand, if there is one
-			for (int i = 0; i < operand_len; i++) {
-				if (command[i+2] != 0x00) {
-					operand[i] = command[i+2];
-				} else {
-					operand[i] = 0x00;
-				}
-			}
-			/************************************************************************/
-			/* Mode-selection commands                                              */
-			/************************************************************************/
-			if(!strcmp(opcode,"SM")) {//set service mode to true;
-				/*
-				 * SM - Enter Service Mode
-				 */
-				str = "Entering Service Mode\n\r";
-				Serial_write_string(0,str,strlen(str));
-				service_mode = 1;
-			} else if (!strcmp(opcode,"TM")) {//toggle service mode
-				/*
-				 * TM - Toggle Modes
-				 */
-				service_mode = !service_mode;
-				if (service_mode) {
-					str = "Entering Service Mode\n\r";
-					Serial_write_string(0,str,strlen(str));
-				} else {
-					str = "Entering Operating Mode\n\r";
-					Serial_write_string(0,str,strlen(str));
-				}
-			} else if (!strcmp(opcode, "OM")) {//set service mode to false
-				/*
-				 * OM - Enter Operating Mode
-				 */
-				str = "Entering Operating Mode\n\r";
-				Serial_write_string(0,str,strlen(str));
-				service_mode = 0;
-			} else {
-				/************************************************************************/
-				/* Mode-specific commands                                               */
-				/************************************************************************/
-				if(service_mode) {
-					//do service mode things
-					if (!strcmp(opcode, "GT")) {
-						/*
-						 * GT - Get current Temperature
-						 */
-						char fmt_temp = last_temp;
-						if (!celsius) {
-							//this is equivalent to (9/5)*C + 32
-							fmt_temp = ((fmt_temp + (fmt_temp << 3))+160)/5;
-						}
-						sprintf((char *) message, format, fmt_temp);
-						Serial_write_string(0, (char *) message, strlen((char *) message));
-					} else if (!strcmp(opcode, "OV")) {
-						/*
-						 * OV#+ - set maximum allowed temperature before shutdown
-						 * Expects a 1-3 digit temperature in Celsius
-						 */
-						over_temp = atoi(operand);
-						formatStr = "Over-temperature set to %d degrees Celsius\n\r";
-						sprintf((char *) message,formatStr,over_temp);
-						Serial_write_string(0, (char *) message, strlen((char *) message));
-					} else if (!strcmp(opcode, "SO")) {
-						/*
-						 * SO#+ - set the timeOut
-						 * Expects a 1-3 digit number of minutes to attempt to reach
-						 * target temperature before shutting down.
-						 */
-						timeout = atoi(operand) * 60;
-						formatStr = "Timeout set to %d seconds\n\r";
-						sprintf((char *) message,formatStr,timeout);
-						Serial_write_string(0, (char *) message, strlen((char *) message));
-						x_new(3, timeout_controller, 1);//kick off the timeout
-					} else if (!strcmp(opcode, "TL")) {
-						/*
-						 * TL - Toogle Lights
-						 */
-						PORTB ^= (0x1 << light_bulbs);
-						str = "Toggling Lights\n\r";
-						Serial_write_string(0,str,strlen(str));
-					} else if (!strcmp(opcode, "TF")) {
-						/*
-						 * TF - Toggle fans
-						 */
-						PORTB ^= (0x1 << fans);
-						str = "Toggling Fans\n\r";
-						Serial_write_string(0,str,strlen(str));
-					} else {
-						/*
-						 * Catch-all: If execution reaches here, the user has entered an
-						 * opcode that is not valid in Service Mode.
-						 */
-						str = "Unrecognized command\n\r";
-						Serial_write_string(0,str,strlen(str));
-					}
-				} else {
-					//do operating mode things
-					if (!strcmp(opcode, "ST")) {
-						/*
-						 * ST#+ - Set Target temperature
-						 * Expects a 1-3 digit Celsius temperature as the target.
-						 */
-						target_temp = atoi(operand);
-						if (target_temp < 0 || target_temp > 125) {
-							str = "Invalid temperature selection.\n\r";
-							Serial_write_string(0,str,strlen(str));
-						} else {
-							formatStr = "Set target temperature to %d degrees Celsius\n\r";
-							sprintf((char *) message,formatStr,target_temp);
-							Serial_write_string(0, (char *) message, strlen((char *) message));
-						}
-					} else if (!strcmp(opcode, "SR")) {
-						/*
-						 * SR#+ - Set sample rate
-						 * Expects a 1-5 digit sample rate in milliseconds.
-						 */
-						sample_rate = atoi(operand);
-						formatStr = "Set sample rate to %u\n\r";
-						sprintf((char *) message,formatStr,sample_rate);
-						Serial_write_string(0, (char *) message, strlen((char *) message));
-					} else if (!strcmp(opcode, "SD")) {
-						/*
-						 * SD_ - Set Display format
-						 * Expects a character indicating the desired display format.
-						 *   C - Degrees Celsius
-						 *	 F - Degrees Fahrenheit
-						 *   X - Hexadecimal number, still Degrees Celsius
-						 */
-						switch (operand[0]) {
-							case 'F':
-								format = "Last temp: %d degrees Fahrenheit\n\r";
-								celsius = 0;
-								str = "Set format to Fahrenheit\n\r";
-								Serial_write_string(0,str,strlen(str));
-								break;
-							case 'C':
-								format = "Last temp: %d degrees Celsius\n\r";
-								celsius = 1;
-								str = "Set format to Celsius\n\r";
-								Serial_write_string(0,str,strlen(str));
-								break;
-							case 'X':
-								celsius = 1;
-								format="Last temp: %x raw hex";
-								str = "Set format to Celsius Hexadecimal\n\r";
-								Serial_write_string(0,str,strlen(str));
-								break;
-							default:
-								str = "Unrecognized format\n\r";
-								Serial_write_string(0,str,strlen(str));
-								break;
-						}
-					} else {
-						/*
-						 * Catch-all: If execution reaches here, the user has entered an
-						 * opcode that is not valid in Operating Mode.
-						 */
-						str = "Unrecognized command\n\r";
-						Serial_write_string(0,str,strlen(str));
-					}
-				}
-			}
+		int ok;
+		if (binary_telemetry) {
+			ok = Serial_read_line(0,frame,TLM_COMMAND_FRAME_MAX)
+				&& Telemetry_decode_command(frame,command,command_len);
 		} else {
-			str = "Error reading command\n\r";
-			Serial_write_string(0,str,strlen(str));
+			ok = Serial_read_line(0,command,command_len);
+		}
+		if(ok) {
+			run_command(command);
+		} else {
+			reply_line_P(PSTR("Error reading command\n\r"));
 		}
 		x_yield();
 	}
 }
 
 /*
- * Controller for the box
+ * The sensor table entry a zone reads: the one with its assigned ROM ID,
+ * or entry <zone> if none is assigned. ZONE_NO_SENSOR if there is none.
+ */
+uint8_t zone_sensor(uint8_t zone, const CONFIG_ZONE * cz) {
+	static const uint8_t unassigned[8] = {0};
+
+	if (!memcmp(cz->rom, unassigned, 8)) {
+		return zone < OW_MAX_SENSORS ? zone : ZONE_NO_SENSOR; //may be the Skip ROM fallback reading
+	}
+	for (uint8_t i = 0; i < ow_sensor_count; i++) {
+		if (!memcmp(cz->rom, ow_sensors[i].rom, 8)) {
+			return i;
+		}
+	}
+	return ZONE_NO_SENSOR;
+}
+
+/*
+ * Act on one reading of a zone's sensor. The PID sees the filtered temperature,
+ * the over-temperature check the median as well; the history keeps zone 0's
+ * raw readings.
+ */
+void control_step(uint8_t zone, unsigned long time, int temp, const CONFIG_ZONE * cz, ZONE_STATUS * s) {
+	uint8_t mode = CONTROL_RUN; //only drive the outputs in operating mode
+
+	if (zones_shut & (1 << zone)) {
+		mode = CONTROL_OFF; //outputs stay off
+	} else if (service_mode) {
+		mode = CONTROL_MONITOR;
+	}
+	if (zone == 0) {
+		history_add(time, temp);
+	}
+	s->time = time;
+	if (control_update(&zones[zone], zone, mode, temp, cz->target_temp, cz->over_temp, &s->temp, &s->output) == CONTROL_OVER_TEMP) {
+		shut_down(zone, PSTR("Maximum Temperature exceeded; Shutting down.\n\r"));
+	}
+}
+
+/*
+ * Controller for the zones: the control stage of the sample pipeline.
+ * Every zone is stepped on each round of readings, in zone order.
  *
  * Fans on by default
  */
 void box_controller(void) {
-	//Configure pins and enable fans
-	DDRB |= (0x1 << light_bulbs) | (0x1 << fans);
-	PORTB &= ~(0x1 << fans);
+	uint8_t seen = sample_event.seq;
+	//static: the records grow with ZONE_COUNT and the stack is T0_STACK_SIZE bytes
+	static CONFIG c, applied;
+	static STATUS s;
+
+	//Configure the PWM outputs and enable fans
+	pwm_init();
+	get_config(&applied);
+	for (uint8_t z = 0; z < ZONE_COUNT; z++) {
+		pwm_set_fan(z, PWM_FAN_DEFAULT);
+		pid_init(&zones[z].pid, applied.kp, applied.ki, applied.kd);
+		filter_init(&zones[z].filter, applied.filter_median, applied.filter_alpha);
+		s.zone[z].time = 0;
+		s.zone[z].temp = 0;
+		s.zone[z].output = 0;
+		s.zone[z].sensor = ZONE_NO_SENSOR;
+	}
 	while(1) {
-		if (last_temp >= over_temp) { //abort if temperature too high
-			char * message = "Maximum Temperature exceeded; Shutting down.\n\r";
-			Serial_write_string(0, message, strlen(message));
-			shut_down();
+		//run once per new sample, so the PID sees a fixed update rate
+		seen = event_wait(&sample_event, seen);
+
+		//take up changed gains and filter settings between steps, never during one
+		get_config(&c);
+		for (uint8_t z = 0; z < ZONE_COUNT; z++) {
+			ZONE * zone = &zones[z];
+			if (c.ki != applied.ki) {
+				pid_reset(&zone->pid); //the integral was summed under the old gain
+			}
+			zone->pid.kp = c.kp;
+			zone->pid.ki = c.ki;
+			zone->pid.kd = c.kd;
+			if (c.filter_median != applied.filter_median || c.filter_alpha != applied.filter_alpha) {
+				filter_init(&zone->filter, c.filter_median, c.filter_alpha);
+			}
+
+			//a zone's filter must not mix readings from two sensors
+			uint8_t sensor = zone_sensor(z, &c.zone[z]);
+			if (sensor != s.zone[z].sensor) {
+				filter_reset(&zone->filter);
+				pid_reset(&zone->pid);
+				s.zone[z].sensor = sensor;
+			}
+			//without a reading the zone's outputs stay as they are
+			if (sensor != ZONE_NO_SENSOR && (sample.valid & (1 << sensor))) {
+				control_step(z, sample.time, sample.temp[sensor], &c.zone[z], &s.zone[z]);
+			}
+		}
+		applied = c;
+		snapshot_write(&status_snapshot, &s);
+		event_publish(&control_event);
+	}
+}
+
+/*
+ * Add one temperature to a batch. A full batch keeps its first 255 samples.
+ */
+void batch_add(BATCH * batch, int16_t temp) {
+	if (batch->count == 0xFF) {
+		return;
+	}
+	if (!batch->count || temp < batch->min) {
+		batch->min = temp;
+	}
+	if (!batch->count || temp > batch->max) {
+		batch->max = temp;
+	}
+	batch->sum += temp;
+	batch->count++;
+}
+
+/*
+ * Mean of a batch, rounded to the nearest 1/16 degree
+ */
+int16_t batch_mean(const BATCH * batch) {
+	int32_t half = batch->count >> 1;
+	return (batch->sum + (batch->sum < 0 ? -half : half)) / batch->count;
+}
+
+/*
+ * The zone that reads a sensor, or ZONE_COUNT if none does
+ */
+uint8_t sensor_zone(const STATUS * s, uint8_t sensor) {
+	uint8_t z;
+	for (z = 0; z < ZONE_COUNT && s->zone[z].sensor != sensor; z++)
+		;
+	return z;
+}
+
+/*
+ * Send one report of the batched samples: in binary mode every sensor,
+ * in text one line per zone. A batch of one sample is reported exactly
+ * as a single sample.
+ */
+void report_send(BATCH * batches, uint8_t sensors, unsigned long time, char format, const STATUS * s) {
+	if (binary_telemetry) {
+		for (uint8_t i = 0; i < sensors; i++) {
+			BATCH * b = &batches[i];
+			uint8_t zone = sensor_zone(s, i);
+			uint8_t status = (zone < ZONE_COUNT) ? telemetry_status(zone) : (service_mode ? TLM_STATUS_SERVICE : 0);
+			if (b->count == 1) {
+				Telemetry_send_sample(0, time, i, b->min, status);
+			} else if (b->count) {
+				Telemetry_send_batch(0, time, i, b->count, b->min, b->max, batch_mean(b), status);
+			}
+		}
+		return;
+	}
+	if (service_mode) {
+		return;
+	}
+	for (uint8_t z = 0; z < ZONE_COUNT; z++) {
+		uint8_t sensor = s->zone[z].sensor;
+		if (sensor == ZONE_NO_SENSOR || !batches[sensor].count) {
+			continue;
+		}
+		BATCH * b = &batches[sensor];
+		if (b->count == 1) {
+			reply_temp(z, b->min, format);
+			continue;
 		}
-		if (!service_mode) { //only perform logic here in operating mode
-			if (last_temp < target_temp) { //enable lights
-				PORTB &= ~(0x1 << light_bulbs);
-			} else { //disable lights
-				PORTB |= (0x1 << light_bulbs);
+		reply_begin();
+		reply_zone(z);
+		reply_P(PSTR("Last "));
+		reply_uint(b->count);
+		reply_P(PSTR(" temps: mean "));
+		reply_temp_value(batch_mean(b), format);
+		reply_P(PSTR(", min "));
+		reply_temp_value(b->min, format);
+		reply_P(PSTR(", max "));
+		reply_temp_value(b->max, format);
+		reply_temp_unit(format);
+		reply_end();
+	}
+}
+
+/*
+ * Reports the results of the control stage every report_rate milliseconds,
+ * independent of the sample rate. Every round is added to the batch, so none
+ * is lost, and a report is only sent when the TX queue has room for it, so
+ * reporting never holds up acquisition or control. A zone's sensor is
+ * reported as the controller sees it (filtered), the others as read.
+ */
+void report_controller(void) {
+	uint8_t seen = control_event.seq;
+	BATCH batches[OW_MAX_SENSORS];
+	uint8_t sensors = 0;
+	char full = 0;
+	unsigned long started = x_gtime();
+	uint16_t sample_rate, report_rate;
+	char format;
+	static STATUS s; //static: it grows with ZONE_COUNT and the stack is T4_STACK_SIZE bytes
+
+	memset(batches, 0, sizeof(batches));
+	while(1) {
+		seen = event_wait(&control_event, seen);
+		GET_CONFIG_FIELD(sample_rate, &sample_rate);
+		GET_CONFIG_FIELD(report_rate, &report_rate);
+		GET_CONFIG_FIELD(display_format, &format);
+		get_status(&s);
+		for (uint8_t i = 0; i < sample.count; i++) {
+			if (sample.valid & (1 << i)) {
+				uint8_t zone = sensor_zone(&s, i);
+				batch_add(&batches[i], (zone < ZONE_COUNT) ? s.zone[zone].temp : sample.temp[i]);
+				if (batches[i].count == 0xFF) {
+					full = 1; //report as soon as the port allows, whatever the rate
+				}
 			}
 		}
-		x_delay(sample_rate); //wait for next temperature reading to act again
+		if (sample.count > sensors) {
+			sensors = sample.count;
+		}
+
+		//report on the sample nearest the period, not the first one after it
+		if ((!full && sample.time - started + (sample_rate >> 1) < report_rate) || Serial_tx_free(0) < REPORT_TX_FREE) {
+			continue;
+		}
+		report_send(batches, sensors, sample.time, format, &s);
+		memset(batches, 0, sizeof(batches));
+		sensors = 0;
+		full = 0;
+		started = sample.time;
+	}
+}
+
+/*
+ * Caches the sensor table's ROM IDs in EEPROM once any settings save has
+ * finished with it. A search sleeps on the bus, so a save may have started
+ * since the table was loaded; nothing may yield between the check and the
+ * write, or config_save could start the EE_READY ISR under it.
+ */
+void save_sensors(void) {
+	while (config_busy()) {
+		x_delay(OW_POLL_MS);
 	}
+	ow_save_sensors();
 }
 
 /*
- * Polls sensor for temperature every second
+ * Samples the sensor at the configured sample rate: the acquisition stage
+ * of the sample pipeline. The thread sleeps through each conversion instead
+ * of busy-waiting on the 1-Wire bus.
  */
 void sensor_controller(void) {
+	CONFIG c;
+
 	//Check for sensor presence
 	char presence = ow_reset();
 	//keep checking until we detect a sensor
@@ -337,25 +1304,64 @@ void sensor_controller(void) {
 		//give other threads a chance to act during this process
 		x_yield();
 	}
-	
-	//prep I/O
-	char message[64];
-	char fmt_temp;
+	//load the sensor table from the EEPROM cache, or search the bus and cache it
+	//(once any settings save has finished with the EEPROM)
+	while (config_busy()) {
+		x_yield();
+	}
+	if (!ow_load_sensors()) {
+		ow_search_sensors();
+		save_sensors();
+	}
+	get_config(&c);
+	ow_set_resolution((c.resolution >= 9 && c.resolution <= 12) ? c.resolution : ow_resolution);
 	
 	//monitor temperature
 	while(1) {
-		last_temp = ow_read_temperature();
-		if (!service_mode) {
-			fmt_temp = last_temp;
-			if (!celsius) {
-				//this is equivalent to (9/5)*C + 32
-				fmt_temp = ((fmt_temp + (fmt_temp << 3))+160)/5;
+		unsigned long started = x_gtime();
+		get_config(&c);
+		if (rescan_sensors) {
+			rescan_sensors = 0;
+			ow_search_sensors();
+			save_sensors();
+			reply_begin();
+			reply_P(PSTR("Found "));
+			reply_uint(ow_sensor_count);
+			reply_P(PSTR(" sensors\n\r"));
+			reply_end();
+		}
+		if (c.resolution != ow_resolution && c.resolution >= 9 && c.resolution <= 12) {
+			ow_set_resolution(c.resolution);
+		}
+		//one broadcast conversion for every sensor on the bus
+		if (ow_start_conversion()) {
+			//sleep until the sensor reports the conversion done. The resolution is
+			//never copied to EEPROM, so a sensor that lost power is back at 12 bits:
+			//give up only after the 12-bit time, not the one ow_resolution implies
+			unsigned int waited = 0;
+			do {
+				x_delay(OW_POLL_MS);
+				waited += OW_POLL_MS;
+			} while (!ow_conversion_done() && waited < OW_CONVERSION_MS);
+
+			//read each sensor in turn with Match ROM; sensor 0 drives the box
+			//a reading that fails its CRC after every retry is dropped
+			sample.count = ow_read_all();
+			sample.time = x_gtime();
+			sample.valid = 0;
+			for (unsigned char i = 0; i < sample.count; i++) {
+				if (ow_sensors[i].valid) {
+					sample.valid |= 1 << i;
+					sample.temp[i] = ow_sensors[i].temp;
+				}
 			}
-			
-			sprintf((char *) message, format, fmt_temp);
-			Serial_write_string(0, (char *) message, strlen((char *) message));
+			event_publish(&sample_event);
+		}
+		//keep the sampling period at the sample rate, conversion included
+		unsigned long elapsed = x_gtime() - started;
+		if (elapsed < c.sample_rate) {
+			x_delay(c.sample_rate - elapsed);
 		}
-		x_delay(sample_rate);
 	}
 }
 
@@ -363,10 +1369,14 @@ void sensor_controller(void) {
  * Initialize the operating threads of the system.
  */
 int main(void) {
+	//restore the saved settings first, so the threads start fully configured
+	//(no thread is running yet to race with the write)
+	config_load(&config_data);
 	x_init();
 	//Launch main threads
 	x_new(2, io_controller, 1);
 	x_new(1, sensor_controller, 1);
 	x_new(3, timeout_controller, 1);
+	x_new(4, report_controller, 1);
 	x_new(0, box_controller, 1); //replaces main with box control logic)
 }
@@ -0,0 +1,412 @@
+/*
+ * delay_cycles.c
+ *	Host-side cycle-count check of the busy-wait delays in System/System/Delay.h
+ *  and delay_usec.S. The preprocessed delay_usec.S is read from stdin and run
+ *  on a small ATmega2560 instruction model that knows the instructions the
+ *  loop uses and their cycle counts (22-bit PC: call and ret take 5). For every
+ *  N in 0..NMAX (and a few long delays) the cycles from the caller's two ldi
+ *  instructions to the instruction after the call must be exactly N us at
+ *  F_CPU, or no more than the call overhead for N below it. delay_us() is also
+ *  checked to inline exactly us * F_CPU/1e6 cycles for short constant delays
+ *  and to call delay_usec otherwise. Exits non-zero on any mismatch.
+ *
+ *  Build and run at one clock (repeat for each F_CPU the boards use):
+ *          cc -O2 -DF_CPU=16000000 -I../System/System -Ihost -o delay_cycles delay_cycles.c
+ *          cc -E -P -x assembler-with-cpp -DF_CPU=16000000 -I../System/System -Ihost \
+ *              ../System/System/delay_usec.S | ./delay_cycles
+ *
+ * Created: 10/19/2026
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+/*
+ * delay_us() expands to one of these two; record which, and with what
+ */
+static unsigned long inline_cycles;
+static long called_us;
+
+#define __builtin_avr_delay_cycles(cycles)	(inline_cycles = (cycles), called_us = -1)
+
+void delay_usec(unsigned int us)
+{
+	inline_cycles = 0;
+	called_us = us;
+}
+
+#include "Delay.h"
+
+#define NMAX			2000	// every delay up to this is run
+#define LINE_MAX		256
+#define PROGRAM_MAX		512
+
+#define CYCLES_LDI		1
+#define CYCLES_CALL		5
+#define DELAY_SKIP_US	((17 + DELAY_CYCLES_PER_US - 1) / DELAY_CYCLES_PER_US)	// as in delay_usec.S
+
+typedef enum { OP_NOP, OP_SBIW, OP_BRCS, OP_BREQ, OP_RJMP, OP_RET } OPCODE;
+
+typedef struct {
+	OPCODE op;
+	long operand;			// sbiw constant, or branch target (instruction index)
+	int line;
+} INSN;
+
+typedef struct {
+	char name[32];
+	int index;				// instruction the label is on
+} LABEL;
+
+static INSN program[PROGRAM_MAX];
+static int program_len;
+static LABEL labels[64];
+static int label_count;
+static int entry = -1;
+
+/*
+ * Integer expressions as the preprocessor leaves them in operands and .rept
+ * counts: numbers, + - * / and parentheses.
+ */
+static const char *expr_pos;
+
+static long expr_sum(void);
+
+static void expr_space(void)
+{
+	while (isspace((unsigned char) *expr_pos)) {
+		expr_pos++;
+	}
+}
+
+static long expr_atom(void)
+{
+	expr_space();
+	if (*expr_pos == '(') {
+		expr_pos++;
+		long value = expr_sum();
+		expr_space();
+		if (*expr_pos++ != ')') {
+			fprintf(stderr, "missing ) in expression\n");
+			exit(2);
+		}
+		return value;
+	}
+	if (*expr_pos == '-') {
+		expr_pos++;
+		return -expr_atom();
+	}
+	char *end;
+	long value = strtol(expr_pos, &end, 0);
+	if (end == expr_pos) {
+		fprintf(stderr, "bad expression at '%s'\n", expr_pos);
+		exit(2);
+	}
+	expr_pos = end;
+	while (*expr_pos == 'U' || *expr_pos == 'L' || *expr_pos == 'u' || *expr_pos == 'l') {
+		expr_pos++;
+	}
+	return value;
+}
+
+static long expr_product(void)
+{
+	long value = expr_atom();
+	while (1) {
+		expr_space();
+		if (*expr_pos == '*') {
+			expr_pos++;
+			value *= expr_atom();
+		} else if (*expr_pos == '/') {
+			expr_pos++;
+			value /= expr_atom();
+		} else {
+			return value;
+		}
+	}
+}
+
+static long expr_sum(void)
+{
+	long value = expr_product();
+	while (1) {
+		expr_space();
+		if (*expr_pos == '+') {
+			expr_pos++;
+			value += expr_product();
+		} else if (*expr_pos == '-') {
+			expr_pos++;
+			value -= expr_product();
+		} else {
+			return value;
+		}
+	}
+}
+
+static long eval(const char *text)
+{
+	expr_pos = text;
+	return expr_sum();
+}
+
+/*
+ * Branch targets: "name", or "Nb"/"Nf" for the nearest local label N backwards
+ * or forwards. Forward references are resolved after the whole file is read.
+ */
+typedef struct {
+	int insn;
+	char target[32];
+	int line;
+} FIXUP;
+
+static FIXUP fixups[64];
+static int fixup_count;
+
+static int resolve(const char *target, int from, int line)
+{
+	size_t len = strlen(target);
+	char dir = len > 1 && isdigit((unsigned char) target[0]) ? target[len - 1] : 0;
+	int found = -1;
+
+	for (int i = 0; i < label_count; i++) {
+		if (dir == 'b' || dir == 'f') {
+			if (strncmp(labels[i].name, target, len - 1) || labels[i].name[len - 1]) {
+				continue;
+			}
+			if (dir == 'b' && labels[i].index <= from) {
+				found = labels[i].index;	// the last one wins: nearest backwards
+			} else if (dir == 'f' && labels[i].index > from && found < 0) {
+				found = labels[i].index;	// the first one wins: nearest forwards
+			}
+		} else if (!strcmp(labels[i].name, target)) {
+			found = labels[i].index;
+		}
+	}
+	if (found < 0) {
+		fprintf(stderr, "line %d: unknown label %s\n", line, target);
+		exit(2);
+	}
+	return found;
+}
+
+static void emit(OPCODE op, long operand, const char *target, int line)
+{
+	if (program_len == PROGRAM_MAX) {
+		fprintf(stderr, "program too long\n");
+		exit(2);
+	}
+	program[program_len].op = op;
+	program[program_len].operand = operand;
+	program[program_len].line = line;
+	if (target) {
+		fixups[fixup_count].insn = program_len;
+		fixups[fixup_count].line = line;
+		snprintf(fixups[fixup_count].target, sizeof(fixups[0].target), "%s", target);
+		fixup_count++;
+	}
+	program_len++;
+}
+
+/*
+ * Assembles one statement (no label). .rept blocks are expanded by the caller.
+ */
+static void assemble(char *text, int line)
+{
+	char mnemonic[16];
+	char *args;
+
+	if (sscanf(text, "%15s", mnemonic) != 1 || mnemonic[0] == '.') {
+		return;		// blank, or a directive with no effect on timing (.section, .global)
+	}
+	args = strstr(text, mnemonic) + strlen(mnemonic);
+	while (isspace((unsigned char) *args)) {
+		args++;
+	}
+	args[strcspn(args, "\r\n")] = 0;
+
+	if (!strcmp(mnemonic, "nop")) {
+		emit(OP_NOP, 0, NULL, line);
+	} else if (!strcmp(mnemonic, "ret")) {
+		emit(OP_RET, 0, NULL, line);
+	} else if (!strcmp(mnemonic, "sbiw")) {
+		char *comma = strchr(args, ',');
+		if (!comma || strncmp(args, "r24", 3)) {
+			fprintf(stderr, "line %d: only sbiw r24,K is modeled\n", line);
+			exit(2);
+		}
+		emit(OP_SBIW, eval(comma + 1), NULL, line);
+	} else if (!strcmp(mnemonic, "brcs") || !strcmp(mnemonic, "breq") || !strcmp(mnemonic, "rjmp")) {
+		char target[32];
+		sscanf(args, "%31s", target);
+		emit(mnemonic[0] == 'r' ? OP_RJMP : mnemonic[3] == 's' ? OP_BRCS : OP_BREQ, 0, target, line);
+	} else {
+		fprintf(stderr, "line %d: instruction %s is not modeled\n", line, mnemonic);
+		exit(2);
+	}
+}
+
+static void load(FILE *in)
+{
+	char text[LINE_MAX];
+	char block[16][LINE_MAX];
+	int block_lines[16];
+	int block_len = 0;
+	long repeat = -1;			// >= 0 inside a .rept block
+	int line = 0;
+
+	while (fgets(text, sizeof(text), in)) {
+		char *stmt = text;
+		char *colon;
+
+		line++;
+		while (isspace((unsigned char) *stmt)) {
+			stmt++;
+		}
+		if (repeat >= 0) {
+			if (!strncmp(stmt, ".endr", 5)) {
+				for (long r = 0; r < repeat; r++) {
+					for (int i = 0; i < block_len; i++) {
+						assemble(block[i], block_lines[i]);
+					}
+				}
+				repeat = -1;
+			} else if (block_len < 16) {
+				snprintf(block[block_len], LINE_MAX, "%s", stmt);
+				block_lines[block_len++] = line;
+			}
+			continue;
+		}
+		if (!strncmp(stmt, ".rept", 5)) {
+			repeat = eval(stmt + 5);
+			block_len = 0;
+			if (repeat < 0) {
+				fprintf(stderr, "line %d: negative .rept count\n", line);
+				exit(2);
+			}
+			continue;
+		}
+		colon = strchr(stmt, ':');
+		if (colon && colon[1] != ':') {
+			*colon = 0;
+			snprintf(labels[label_count].name, sizeof(labels[0].name), "%.31s", stmt);
+			labels[label_count++].index = program_len;
+			if (!strcmp(stmt, "delay_usec")) {
+				entry = program_len;
+			}
+			stmt = colon + 1;
+		}
+		assemble(stmt, line);
+	}
+	for (int i = 0; i < fixup_count; i++) {
+		program[fixups[i].insn].operand = resolve(fixups[i].target, fixups[i].insn, fixups[i].line);
+	}
+	if (entry < 0) {
+		fprintf(stderr, "no delay_usec label on stdin\n");
+		exit(2);
+	}
+}
+
+/*
+ * Cycles from the caller's "ldi r24/ldi r25" to the instruction after the call.
+ */
+static unsigned long run(unsigned int n)
+{
+	unsigned long cycles = 2 * CYCLES_LDI + CYCLES_CALL;
+	unsigned int r24 = n;
+	int carry = 0, zero = 0;
+	int pc = entry;
+
+	while (1) {
+		const INSN *insn = &program[pc++];
+		switch (insn->op) {
+			case OP_NOP:
+				cycles += 1;
+				break;
+			case OP_SBIW:
+				carry = r24 < (unsigned long) insn->operand;
+				r24 = (r24 - insn->operand) & 0xFFFF;
+				zero = (r24 == 0);
+				cycles += 2;
+				break;
+			case OP_BRCS:
+			case OP_BREQ:
+				if (insn->op == OP_BRCS ? carry : zero) {
+					pc = insn->operand;
+					cycles += 2;
+				} else {
+					cycles += 1;
+				}
+				break;
+			case OP_RJMP:
+				pc = insn->operand;
+				cycles += 2;
+				break;
+			case OP_RET:
+				return cycles + 5;
+		}
+		if (pc >= program_len) {
+			fprintf(stderr, "ran off the end of delay_usec\n");
+			exit(2);
+		}
+	}
+}
+
+static int failures;
+
+static void check_call(unsigned int n)
+{
+	unsigned long cycles = run(n);
+	unsigned long want = (unsigned long) n * DELAY_CYCLES_PER_US;
+	unsigned long overhead = (unsigned long) DELAY_SKIP_US * DELAY_CYCLES_PER_US;
+
+	if (n >= DELAY_SKIP_US ? cycles != want : (cycles < want || cycles > overhead)) {
+		printf("delay_usec(%u): %lu cycles, want %lu\n", n, cycles, n >= DELAY_SKIP_US ? want : overhead);
+		failures++;
+	}
+}
+
+/*
+ * delay_us(us) with a constant must inline exactly us microseconds up to
+ * DELAY_INLINE_MAX_US, and call delay_usec(us) above it
+ */
+#define CHECK_INLINE(us) do { \
+	delay_us(us); \
+	if ((us) <= DELAY_INLINE_MAX_US ? (called_us != -1 || inline_cycles != (us) * (unsigned long) DELAY_CYCLES_PER_US) \
+			: called_us != (us)) { \
+		printf("delay_us(%d): inline %lu cycles, called with %ld\n", (us), inline_cycles, called_us); \
+		failures++; \
+	} \
+} while (0)
+
+int main(void)
+{
+	load(stdin);
+
+	for (unsigned int n = 0; n <= NMAX; n++) {
+		check_call(n);
+	}
+	check_call(10000);
+	check_call(65535);
+
+	CHECK_INLINE(1);
+	CHECK_INLINE(2);
+	CHECK_INLINE(10);
+	CHECK_INLINE(12);
+	CHECK_INLINE(DELAY_INLINE_MAX_US);
+	CHECK_INLINE(DELAY_INLINE_MAX_US + 1);
+	CHECK_INLINE(60);
+	CHECK_INLINE(480);
+	for (volatile unsigned int us = 1; us < 3; us++) {
+		delay_us(us);	// not a constant: always the call
+		if (called_us != us) {
+			printf("delay_us(variable %u) did not call delay_usec\n", us);
+			failures++;
+		}
+	}
+
+	printf("F_CPU %lu: delay_usec 0..%d, 10000, 65535 and delay_us inlining: %s\n",
+		(unsigned long) F_CPU, NMAX, failures ? "FAILED" : "ok");
+	return failures != 0;
+}
@@ -0,0 +1,750 @@
+/*
+ * ds18b20_sim.c
+ *	Host-side test of the 1-Wire driver (System/System/DS18B20.c, PE4 backend)
+ *  against a model of DS18B20s on the bus. The driver is built unchanged
+ *  against the register stand-ins in host/: a DDRE write is the master
+ *  pulling or releasing the bus, a PINE read samples the wired-AND bus, and
+ *  while the calling thread is parked in ACX the TIMER3 compare ISR is run at
+ *  its match time (plus an entry latency) in virtual time.
+ *
+ *  Every edge is checked against the DS18B20 datasheet windows: reset low
+ *  time and reset time slot, presence sample point, slot length, recovery,
+ *  write-0 and write-1 low times and the read sample point. The sensors
+ *  answer Search, Match, Skip and Read ROM, Convert T (busy for the
+ *  resolution's conversion time), and Write and Read Scratchpad with a
+ *  correct CRC, or a corrupted one on request.
+ *
+ *  Build:  cc -O2 -Ihost -I../System/System -o ds18b20_sim ds18b20_sim.c ../System/System/DS18B20.c
+ *  Use:    ds18b20_sim       (every test; exits non-zero on a failure or timing violation)
+ *          ds18b20_sim -v    (also prints each bus edge)
+ *
+ * Created: 10/19/2026
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "System.h"
+#include "acx.h"
+#include "DS18B20.h"
+
+#define US(x)			((uint64_t) (x) * 1000)		// virtual time is in nanoseconds
+#define MS(x)			((uint64_t) (x) * 1000000)
+#define MAX_DEVICES		6
+#define TIMER3_HZ		(F_CPU / 8)					// ow_transfer runs TIMER3 at clkIO/8
+
+void TIMER3_COMPA_vect(void);
+
+/*
+ * The AVR side: registers, ACX and the delay loop
+ */
+volatile uint8_t DDRE, PORTE, TCCR3A, TCCR3B, TIFR3, TIMSK3;
+volatile uint16_t OCR3A;
+
+byte x_thread_id = 0;
+byte x_thread_mask = 1;
+
+static uint64_t now;				// virtual time, ns
+static uint64_t isr_latency = US(2);	// compare match to the ISR's first instruction
+static uint64_t presence_latency = US(2);	// the same for the matches after a reset
+static int parked;
+static int verbose;
+
+/*
+ * One sensor on the bus
+ */
+enum {
+	DEV_IDLE,			// ignores slots until the next reset
+	DEV_ROM_CMD,		// receiving a ROM command
+	DEV_MATCH,			// receiving a Match ROM ID
+	DEV_SEARCH,			// Search ROM: bit, complement, then the master's choice
+	DEV_FUNC_CMD,		// selected, receiving a function command
+	DEV_WRITE_SP,		// receiving TH, TL and configuration
+	DEV_SEND,			// sending buf (Read Scratchpad or Read ROM), then 1s
+	DEV_CONVERTING		// answering read slots with 0 until the conversion is done
+};
+
+typedef struct {
+	uint8_t rom[8];
+	int16_t temp;				// what it measures, 1/16 degree Celsius
+	uint8_t scratch[9];
+	uint64_t presence_wait;		// release to presence pulse, 15-60us
+	uint64_t presence_len;		// presence pulse, 60-240us
+	unsigned conv_permille;		// conversion time as a share of the datasheet maximum
+	int corrupt;				// scratchpad reads still to send with a flipped bit
+
+	int state;
+	int bits;					// bits received or sent in this state
+	uint8_t buf[9];
+	int send_bits;
+	int search_phase;
+	uint64_t conv_end;			// 0 while no conversion is pending
+	uint64_t pull_from;			// when it holds the bus low
+	uint64_t pull_until;
+} DEVICE;
+
+static DEVICE devices[MAX_DEVICES];
+static int device_count;
+
+/*
+ * What the master did last
+ */
+static int master_low;
+static uint64_t fall_at, rise_at;
+static uint64_t reset_rise;			// release of the last reset, until the next slot starts
+static uint64_t slot_fall;			// start of the last slot, 0 after a reset
+static int read_slot;				// a sensor is sending in the current slot
+
+static long violations;
+static int failures;
+
+static void violation(const char *fmt, ...)
+{
+	va_list ap;
+
+	if (violations++ < 20) {
+		printf("  timing at %.1f us: ", now / 1000.0);
+		va_start(ap, fmt);
+		vprintf(fmt, ap);
+		va_end(ap);
+		putchar('\n');
+	}
+}
+
+/*
+ * Dallas/Maxim CRC8, bit by bit (independent of the driver's table)
+ */
+static uint8_t crc8(const uint8_t *data, int len)
+{
+	uint8_t crc = 0;
+	while (len--) {
+		uint8_t byte = *data++;
+		for (int i = 0; i < 8; i++) {
+			uint8_t mix = (crc ^ byte) & 0x01;
+			crc >>= 1;
+			if (mix) {
+				crc ^= 0x8C;
+			}
+			byte >>= 1;
+		}
+	}
+	return crc;
+}
+
+static int resolution(const DEVICE *d)
+{
+	return 9 + ((d->scratch[4] >> 5) & 0x03);
+}
+
+/*
+ * The temperature register at the device's resolution. The bits below it
+ * are undefined; they are set so that a driver that does not mask them shows.
+ */
+static void temperature_register(DEVICE *d)
+{
+	uint16_t undefined = (1 << (12 - resolution(d))) - 1;
+	uint16_t reg = ((uint16_t) d->temp & ~undefined) | undefined;
+
+	d->scratch[0] = reg & 0xFF;
+	d->scratch[1] = reg >> 8;
+}
+
+static void device_init(DEVICE *d, const uint8_t *serial, uint8_t family, int16_t temp)
+{
+	memset(d, 0, sizeof(*d));
+	d->rom[0] = family;
+	memcpy(d->rom + 1, serial, 6);
+	d->rom[7] = crc8(d->rom, 7);
+	d->temp = temp;
+	d->presence_wait = US(30);
+	d->presence_len = US(120);
+	d->conv_permille = 1000;
+	d->scratch[0] = 0x50;				// power-on reading, 85 degrees
+	d->scratch[1] = 0x05;
+	d->scratch[2] = 0x4B;
+	d->scratch[3] = 0x46;
+	d->scratch[4] = 0x7F;				// 12 bits
+	d->scratch[5] = 0xFF;
+	d->scratch[6] = 0x0C;
+	d->scratch[7] = 0x10;
+	d->state = DEV_IDLE;
+}
+
+/*
+ * The bit a device sends in a read slot starting at t, or -1 if it is not sending
+ */
+static int device_bit(DEVICE *d, uint64_t t)
+{
+	switch (d->state) {
+		case DEV_SEARCH:
+			if (d->search_phase < 2) {
+				int bit = (d->rom[d->bits >> 3] >> (d->bits & 7)) & 1;
+				return d->search_phase ? !bit : bit;
+			}
+			return -1;
+		case DEV_SEND:
+			return d->bits < d->send_bits ? (d->buf[d->bits >> 3] >> (d->bits & 7)) & 1 : 1;
+		case DEV_CONVERTING:
+			return t >= d->conv_end;
+	}
+	return -1;
+}
+
+static void device_send(DEVICE *d, const uint8_t *data, int bytes)
+{
+	memcpy(d->buf, data, bytes);
+	d->send_bits = bytes * 8;
+	d->bits = 0;
+	d->state = DEV_SEND;
+}
+
+/*
+ * A finished conversion is in the scratchpad by the time it is read
+ */
+static void device_settle(DEVICE *d, uint64_t t)
+{
+	if (d->conv_end && t >= d->conv_end) {
+		temperature_register(d);
+		d->conv_end = 0;
+	}
+}
+
+/*
+ * A write slot (or the end of a read slot) with the bit the master sent
+ */
+static void device_slot(DEVICE *d, int bit, uint64_t t)
+{
+	uint8_t *rx = &d->buf[d->bits >> 3];
+
+	if (d->state == DEV_ROM_CMD || d->state == DEV_MATCH || d->state == DEV_FUNC_CMD || d->state == DEV_WRITE_SP) {
+		if ((d->bits & 7) == 0) {
+			*rx = 0;
+		}
+		*rx |= bit << (d->bits & 7);
+		d->bits++;
+	}
+
+	switch (d->state) {
+		case DEV_ROM_CMD:
+			if (d->bits == 8) {
+				d->bits = 0;
+				switch (d->buf[0]) {
+					case 0xCC: d->state = DEV_FUNC_CMD; break;
+					case 0x55: d->state = DEV_MATCH; break;
+					case 0xF0: d->state = DEV_SEARCH; d->search_phase = 0; break;
+					case 0x33: device_send(d, d->rom, 8); break;
+					default: d->state = DEV_IDLE; break;
+				}
+			}
+			break;
+
+		case DEV_MATCH:
+			if (d->bits == 64) {
+				d->bits = 0;
+				d->state = memcmp(d->buf, d->rom, 8) ? DEV_IDLE : DEV_FUNC_CMD;
+			}
+			break;
+
+		case DEV_SEARCH:
+			if (d->search_phase < 2) {
+				d->search_phase++;
+			} else if (bit != ((d->rom[d->bits >> 3] >> (d->bits & 7)) & 1)) {
+				d->state = DEV_IDLE;	//the master took the other branch
+			} else {
+				d->search_phase = 0;
+				if (++d->bits == 64) {
+					d->bits = 0;
+					d->state = DEV_FUNC_CMD;
+				}
+			}
+			break;
+
+		case DEV_FUNC_CMD:
+			if (d->bits == 8) {
+				d->bits = 0;
+				switch (d->buf[0]) {
+					case 0x44:
+						d->conv_end = t + MS(750) * d->conv_permille / 1000 / (1 << (12 - resolution(d)));
+						d->state = DEV_CONVERTING;
+						break;
+					case 0x4E:
+						d->state = DEV_WRITE_SP;
+						break;
+					case 0xBE: {
+						uint8_t pad[9];
+						device_settle(d, t);
+						d->scratch[8] = crc8(d->scratch, 8);
+						memcpy(pad, d->scratch, 9);
+						if (d->corrupt > 0) {
+							d->corrupt--;
+							pad[0] ^= 0x04;		//a bit flipped on the wire
+						}
+						device_send(d, pad, 9);
+						break;
+					}
+					default:
+						d->state = DEV_IDLE;
+						break;
+				}
+			}
+			break;
+
+		case DEV_WRITE_SP:
+			if (d->bits == 24) {
+				d->scratch[2] = d->buf[0];
+				d->scratch[3] = d->buf[1];
+				d->scratch[4] = (d->buf[2] & 0x60) | 0x1F;
+				d->state = DEV_IDLE;
+			}
+			break;
+
+		case DEV_SEND:
+			d->bits++;
+			break;
+	}
+}
+
+/*
+ * The master released the bus after low, at t
+ */
+static void master_rise(uint64_t t)
+{
+	uint64_t low = t - fall_at;
+
+	rise_at = t;
+	if (low >= US(480)) {
+		reset_rise = t;
+		slot_fall = 0;
+		for (int i = 0; i < device_count; i++) {
+			DEVICE *d = &devices[i];
+			device_settle(d, t);
+			d->state = DEV_ROM_CMD;
+			d->bits = 0;
+			d->pull_from = t + d->presence_wait;
+			d->pull_until = d->pull_from + d->presence_len;
+		}
+		return;
+	}
+	if (low > US(120)) {
+		violation("bus low %.1f us: too long for a slot, too short for a reset", low / 1000.0);
+	} else if (low >= US(15) && low < US(60)) {
+		violation("bus low %.1f us: not a write-1 (under 15) or a write-0 (60-120)", low / 1000.0);
+	} else if (low < US(1)) {
+		violation("bus low %.1f us, under 1", low / 1000.0);
+	}
+	for (int i = 0; i < device_count; i++) {
+		device_slot(&devices[i], low < US(15), t);
+	}
+}
+
+/*
+ * The master pulled the bus low at t: a reset or the start of a slot
+ */
+static void master_fall(uint64_t t)
+{
+	uint64_t high_since = rise_at;
+
+	for (int i = 0; i < device_count; i++) {
+		if (devices[i].pull_from <= t && t < devices[i].pull_until) {
+			violation("master pulls the bus low while a sensor holds it");
+		}
+		if (devices[i].pull_until <= t && devices[i].pull_until > high_since) {
+			high_since = devices[i].pull_until;
+		}
+	}
+	if (reset_rise) {
+		if (t - reset_rise < US(480)) {
+			violation("reset time slot %.1f us, under 480", (t - reset_rise) / 1000.0);
+		}
+		reset_rise = 0;
+	} else if (slot_fall) {
+		if (t - slot_fall < US(60)) {
+			violation("slot %.1f us, under 60", (t - slot_fall) / 1000.0);
+		}
+		if (t - high_since < US(1)) {
+			violation("recovery %.1f us, under 1", (t - high_since) / 1000.0);
+		}
+	}
+	fall_at = t;
+	slot_fall = t;
+	read_slot = 0;
+	for (int i = 0; i < device_count; i++) {
+		DEVICE *d = &devices[i];
+		int bit = device_bit(d, t);
+		if (bit >= 0) {
+			read_slot = 1;
+		}
+		if (bit == 0) {
+			d->pull_from = t;
+			d->pull_until = t + US(15);		//the shortest a sensor holds a 0
+		}
+	}
+}
+
+/*
+ * Catches up with the master's pin. DDRE only changes in code that takes no
+ * virtual time, so an edge happened at the time of the hook that sees it.
+ */
+static void bus_sync(void)
+{
+	int low = (DDRE >> PE4) & 1;
+
+	if (low && (PORTE & (1 << PE4))) {
+		violation("master drives the bus high");
+	}
+	if (low == master_low) {
+		return;
+	}
+	master_low = low;
+	if (verbose) {
+		printf("  %12.1f us %s\n", now / 1000.0, low ? "low" : "released");
+	}
+	if (low) {
+		master_fall(now);
+	} else {
+		master_rise(now);
+	}
+}
+
+uint8_t sim_pine(void)
+{
+	int low = master_low;
+
+	bus_sync();
+	if (reset_rise) {
+		uint64_t after = now - reset_rise;
+		if (after < US(60) || after > US(75)) {
+			violation("presence sampled %.1f us after release, outside 60-75", after / 1000.0);
+		}
+	} else if (read_slot && !master_low && now - fall_at >= US(15)) {
+		violation("read sampled %.1f us into the slot, past 15", (now - fall_at) / 1000.0);
+	}
+	for (int i = 0; i < device_count; i++) {
+		low |= devices[i].pull_from <= now && now < devices[i].pull_until;
+	}
+	return low ? 0 : (1 << PE4);
+}
+
+static uint64_t timer3_ticks(void)
+{
+	return now * TIMER3_HZ / 1000000000ULL;
+}
+
+uint16_t sim_tcnt3(void)
+{
+	bus_sync();
+	return (uint16_t) timer3_ticks();
+}
+
+void sim_delay_cycles(unsigned long cycles)
+{
+	bus_sync();
+	now += (uint64_t) cycles * 1000000000ULL / F_CPU;
+}
+
+void delay_usec(unsigned int us)
+{
+	sim_delay_cycles((unsigned long) us * (F_CPU / 1000000));
+}
+
+/*
+ * Time of the next TIMER3 compare match
+ */
+static uint64_t timer3_match(void)
+{
+	uint64_t tick = timer3_ticks();
+	uint32_t ahead = (uint16_t) (OCR3A - (uint16_t) tick);
+
+	if (TCCR3B != (1 << CS31)) {
+		printf("  TIMER3 is not running at clkIO/8\n");
+		exit(2);
+	}
+	if (ahead == 0) {
+		ahead = 0x10000;
+	}
+	return ((tick + ahead) * 1000000000ULL + TIMER3_HZ - 1) / TIMER3_HZ;
+}
+
+static void timer3_fire(void)
+{
+	now = timer3_match() + (reset_rise ? presence_latency : isr_latency);
+	TIMER3_COMPA_vect();
+	bus_sync();
+}
+
+/*
+ * Runs the ISR until the parked thread is woken
+ */
+void x_yield(void)
+{
+	uint64_t limit = now + MS(100);
+
+	bus_sync();
+	while (parked) {
+		if (!(TIMSK3 & (1 << OCIE3A)) || now > limit) {
+			printf("  thread parked with no transfer to wake it\n");
+			exit(2);
+		}
+		timer3_fire();
+	}
+}
+
+void x_suspend(byte tid)
+{
+	parked = 1;
+}
+
+void x_resume_mask(byte mask)
+{
+	if (mask & x_thread_mask) {
+		parked = 0;
+	}
+}
+
+/*
+ * The thread sleeps for ns (x_delay); compare matches due meanwhile still fire
+ */
+static void sim_sleep(uint64_t ns)
+{
+	uint64_t until = now + ns;
+
+	bus_sync();
+	while ((TIMSK3 & (1 << OCIE3A)) && timer3_match() + isr_latency <= until) {
+		timer3_fire();
+	}
+	now = until;
+}
+
+/*
+ * Test harness
+ */
+static void bus_clear(void)
+{
+	device_count = 0;
+	ow_sensor_count = 0;
+	ow_check_crc = 1;
+	memset(&ow_errors, 0, sizeof(ow_errors));
+	isr_latency = US(2);
+	presence_latency = US(2);
+	now += MS(1);
+	reset_rise = 0;
+	slot_fall = 0;
+}
+
+static DEVICE *bus_add(uint64_t serial, int16_t temp)
+{
+	uint8_t bytes[6];
+
+	for (int i = 0; i < 6; i++) {
+		bytes[i] = serial >> (8 * i);
+	}
+	device_init(&devices[device_count], bytes, OW_FAMILY_DS18B20, temp);
+	return &devices[device_count++];
+}
+
+static void check(int ok, const char *what)
+{
+	printf("%-60s %s\n", what, ok ? "ok" : "FAILED");
+	failures += !ok;
+}
+
+static DEVICE *device_with_rom(const uint8_t *rom)
+{
+	for (int i = 0; i < device_count; i++) {
+		if (!memcmp(devices[i].rom, rom, 8)) {
+			return &devices[i];
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Starts a conversion and polls it as sensor_controller does; returns the
+ * time it took, or 0 if no sensor answered
+ */
+static uint64_t convert(void)
+{
+	uint64_t start = now;
+	if (!ow_start_conversion()) {
+		return 0;
+	}
+	do {
+		sim_sleep(MS(1));
+	} while (!ow_conversion_done() && now - start < MS(2000));
+	return now - start;
+}
+
+static void test_reset(void)
+{
+	static const uint64_t corners[][2] = {{15, 60}, {60, 60}, {60, 240}, {30, 120}};
+	char what[80];
+
+	bus_clear();
+	check(ow_reset() == 0, "reset with no sensor: no presence");
+	for (unsigned i = 0; i < sizeof(corners) / sizeof(corners[0]); i++) {
+		bus_clear();
+		DEVICE *d = bus_add(1, 0);
+		d->presence_wait = US(corners[i][0]);
+		d->presence_len = US(corners[i][1]);
+		snprintf(what, sizeof(what), "presence %llu us after release, %llu us long",
+			(unsigned long long) corners[i][0], (unsigned long long) corners[i][1]);
+		check(ow_reset() == 1, what);
+	}
+}
+
+static void test_skip_rom(void)
+{
+	bus_clear();
+	bus_add(1, 401);		// 25.0625 degrees
+	ow_set_resolution(12);
+	convert();
+	check(ow_read_result() == 401, "Skip ROM conversion and read, 25.0625 C");
+
+	bus_clear();
+	bus_add(1, -162);		// -10.125 degrees
+	convert();
+	check(ow_read_result() == -162, "Skip ROM conversion and read, -10.125 C");
+
+	bus_clear();
+	bus_add(1, 401);
+	ow_check_crc = 0;
+	convert();
+	check(ow_read_result() == 401, "read cut short by a reset (CRC checking off)");
+}
+
+static void test_resolution(void)
+{
+	char what[80];
+
+	for (int bits = 9; bits <= 12; bits++) {
+		bus_clear();
+		DEVICE *d = bus_add(1, 0x191);
+		check(ow_set_resolution(bits) && resolution(d) == bits && d->scratch[2] == OW_ALARM_HIGH && d->scratch[3] == OW_ALARM_LOW,
+			bits == 9 ? "Write Scratchpad sets 9 bits, TH and TL" : "Write Scratchpad sets 10-12 bits, TH and TL");
+		uint64_t max = MS(750) / (1 << (12 - bits));
+		ow_start_conversion();
+		uint64_t start = now;
+		uint64_t end = d->conv_end;
+		do {
+			sim_sleep(MS(1));
+		} while (!ow_conversion_done() && now - start < MS(2000));
+		//done is first seen at the poll after the sensor finishes
+		snprintf(what, sizeof(what), "%d-bit conversion: %.2f ms, seen done %.2f ms after, driver allows %u",
+			bits, max / 1e6, (now - end) / 1e6, ow_conversion_ms());
+		check(end > start && end - start <= max && now >= end && now - end < US(1200) && MS(ow_conversion_ms()) >= max, what);
+		snprintf(what, sizeof(what), "%d-bit reading has the undefined low bits masked", bits);
+		check(ow_read_result() == (0x191 & ~((1 << (12 - bits)) - 1)), what);
+	}
+	ow_set_resolution(12);
+}
+
+static void test_search(void)
+{
+	//serials that share long prefixes, so the search branches at many bits
+	static const uint64_t serials[] = {0x000000000001, 0x000000000003, 0x0000000000F1, 0x800000000001, 0x800000000000};
+	uint8_t found_mask = 0;
+	char what[80];
+
+	bus_clear();
+	for (int i = 0; i < 4; i++) {
+		bus_add(serials[i], 320 + i * 16);
+	}
+	unsigned char count = ow_search_sensors();
+	for (int i = 0; i < count; i++) {
+		DEVICE *d = device_with_rom(ow_sensors[i].rom);
+		if (d) {
+			found_mask |= 1 << (d - devices);
+		}
+	}
+	snprintf(what, sizeof(what), "Search ROM finds all 4 sensors (found %u)", count);
+	check(count == 4 && found_mask == 0x0F, what);
+
+	//one conversion for all, then each read with Match ROM
+	convert();
+	int right = 0;
+	ow_read_all();
+	for (int i = 0; i < count; i++) {
+		DEVICE *d = device_with_rom(ow_sensors[i].rom);
+		right += d && ow_sensors[i].valid && ow_sensors[i].temp == d->temp;
+	}
+	check(right == 4, "Match ROM reads each sensor's own temperature");
+
+	bus_clear();
+	for (int i = 0; i < 5; i++) {
+		bus_add(serials[i], 0);
+	}
+	count = ow_search_sensors();
+	int valid = 1;
+	for (int i = 0; i < count; i++) {
+		valid &= device_with_rom(ow_sensors[i].rom) != NULL;
+		for (int j = 0; j < i; j++) {
+			valid &= memcmp(ow_sensors[i].rom, ow_sensors[j].rom, 8) != 0;
+		}
+	}
+	check(count == OW_MAX_SENSORS && valid, "Search ROM stops at a full table of distinct sensors");
+
+	bus_clear();
+	bus_add(serials[0], 0);
+	bus_add(serials[1], 0)->rom[0] = 0x10;	//a DS18S20: other family, and its CRC no longer matches
+	bus_add(serials[2], 0);
+	count = ow_search_sensors();
+	check(count == 2, "Search ROM skips a device of another family");
+}
+
+static void test_crc(void)
+{
+	bus_clear();
+	DEVICE *d = bus_add(7, 500);
+	convert();
+	d->corrupt = 1;
+	int temp = ow_read_sensor(d->rom);
+	check(temp == 500 && ow_errors.crc == 1 && ow_errors.retries == 1 && ow_errors.failed == 0,
+		"corrupted scratchpad fails the CRC and is read again");
+
+	memset(&ow_errors, 0, sizeof(ow_errors));
+	d->corrupt = OW_READ_RETRIES + 1;
+	temp = ow_read_sensor(d->rom);
+	check(temp == OW_NO_READING && ow_errors.crc == OW_READ_RETRIES + 1 && ow_errors.failed == 1,
+		"a sensor that keeps failing the CRC gives no reading");
+}
+
+static void test_late_isr(void)
+{
+	bus_clear();
+	bus_add(1, 401);
+	bus_add(2, 402);
+	isr_latency = US(25);		//held off by another interrupt at every slot match
+	presence_latency = US(5);	//the most the presence sample allows: 70us against the 75us window
+	ow_search_sensors();
+	convert();
+	ow_read_all();
+	check(ow_sensors[0].temp + ow_sensors[1].temp == 803, "search, conversion and reads with slot ISRs 25 us late");
+}
+
+int main(int argc, char **argv)
+{
+	int opt;
+
+	while ((opt = getopt(argc, argv, "v")) != -1) {
+		if (opt == 'v') {
+			verbose = 1;
+		} else {
+			fprintf(stderr, "usage: %s [-v]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	test_reset();
+	test_skip_rom();
+	test_resolution();
+	test_search();
+	test_crc();
+	test_late_isr();
+
+	printf("F_CPU %lu: %ld timing violations, %d failed checks\n", (unsigned long) F_CPU, violations, failures);
+	return failures || violations;
+}
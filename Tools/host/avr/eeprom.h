@@ -0,0 +1,38 @@
+/*
+ * eeprom.h
+ *	Host stand-in for avr-libc's <avr/eeprom.h>. EEMEM variables are ordinary
+ *  memory that starts from its initializers, as a freshly programmed part does.
+ *
+ * Created: 10/19/2026
+ */
+
+
+#ifndef HOST_AVR_EEPROM_H_
+#define HOST_AVR_EEPROM_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#define EEMEM
+
+static inline uint8_t eeprom_read_byte(const uint8_t *p)
+{
+	return *p;
+}
+
+static inline void eeprom_read_block(void *dst, const void *src, size_t n)
+{
+	memcpy(dst, src, n);
+}
+
+static inline void eeprom_update_byte(uint8_t *p, uint8_t value)
+{
+	*p = value;
+}
+
+static inline void eeprom_update_block(const void *src, void *dst, size_t n)
+{
+	memcpy(dst, src, n);
+}
+
+#endif /* HOST_AVR_EEPROM_H_ */
@@ -0,0 +1,17 @@
+/*
+ * interrupt.h
+ *	Host stand-in for avr-libc's <avr/interrupt.h>. An ISR is an ordinary
+ *  function the host tool calls when its simulated interrupt fires.
+ *
+ * Created: 10/19/2026
+ */
+
+
+#ifndef HOST_AVR_INTERRUPT_H_
+#define HOST_AVR_INTERRUPT_H_
+
+#define ISR(vector)		void vector(void)
+#define sei()
+#define cli()
+
+#endif /* HOST_AVR_INTERRUPT_H_ */
@@ -0,0 +1,51 @@
+/*
+ * io.h
+ *	Host stand-in for avr-libc's <avr/io.h>, so firmware headers (System.h,
+ *  Delay.h) and the 1-Wire driver can be built by the host tools in Tools/.
+ *  Build the tools with -Ihost to pick it up.
+ *
+ *  The registers DS18B20.c uses are plain variables, except PINE and TCNT3,
+ *  which are reads from the bus model (Tools/ds18b20_sim.c) at the current
+ *  virtual time. delay_us() advances that time instead of spinning.
+ *
+ * Created: 10/19/2026
+ */
+
+
+#ifndef HOST_AVR_IO_H_
+#define HOST_AVR_IO_H_
+
+#ifndef __ASSEMBLER__
+#include <stdint.h>
+
+//
+// PORTE and TIMER3, as used by the PE4 1-Wire master
+//
+extern volatile uint8_t DDRE;
+extern volatile uint8_t PORTE;
+extern volatile uint8_t TCCR3A;
+extern volatile uint8_t TCCR3B;
+extern volatile uint8_t TIFR3;
+extern volatile uint8_t TIMSK3;
+extern volatile uint16_t OCR3A;
+
+uint8_t sim_pine(void);
+uint16_t sim_tcnt3(void);
+void sim_delay_cycles(unsigned long);
+
+#define PINE		sim_pine()
+#define TCNT3		sim_tcnt3()
+
+#define PE4			4
+#define CS30		0
+#define CS31		1
+#define OCF3A		1
+#define OCIE3A		1
+
+#ifndef __builtin_avr_delay_cycles
+#define __builtin_avr_delay_cycles(cycles)	sim_delay_cycles(cycles)
+#endif
+
+#endif /* __ASSEMBLER__ */
+
+#endif /* HOST_AVR_IO_H_ */
@@ -0,0 +1,20 @@
+/*
+ * pgmspace.h
+ *	Host stand-in for avr-libc's <avr/pgmspace.h>: flash is ordinary memory.
+ *
+ * Created: 10/19/2026
+ */
+
+
+#ifndef HOST_AVR_PGMSPACE_H_
+#define HOST_AVR_PGMSPACE_H_
+
+#include <string.h>
+
+#define PROGMEM
+#define PSTR(s)					(s)
+#define pgm_read_byte(address)	(*(const uint8_t *) (address))
+#define strlen_P(s)				strlen(s)
+#define memcpy_P(dst, src, n)	memcpy((dst), (src), (n))
+
+#endif /* HOST_AVR_PGMSPACE_H_ */
@@ -0,0 +1,18 @@
+/*
+ * atomic.h
+ *	Host stand-in for avr-libc's <util/atomic.h>. The host tools run the
+ *  firmware and its simulated interrupts on one thread, so a block is
+ *  atomic as it stands.
+ *
+ * Created: 10/19/2026
+ */
+
+
+#ifndef HOST_UTIL_ATOMIC_H_
+#define HOST_UTIL_ATOMIC_H_
+
+#define ATOMIC_RESTORESTATE		0
+#define ATOMIC_FORCEON			0
+#define ATOMIC_BLOCK(type)		for (int atomic_once_ = 1; atomic_once_; atomic_once_ = 0)
+
+#endif /* HOST_UTIL_ATOMIC_H_ */
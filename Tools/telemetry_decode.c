@@ -0,0 +1,216 @@
+/*
+ * telemetry_decode.c
+ *	Host-side companion to System/System/Telemetry.c. Decodes the COBS-framed
+ *  binary telemetry stream read from stdin and prints one line per packet, or
+ *  with -c encodes a command packet to stdout.
+ *
+ *  Build:  cc -O2 -o telemetry_decode telemetry_decode.c
+ *  Use:    telemetry_decode < /dev/ttyACM0
+ *          telemetry_decode -c ST25 > /dev/ttyACM0
+ *
+ * Created: 10/19/2026
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "../System/System/Telemetry.h"
+
+#define FRAME_MAX 1024
+
+/*
+ * Same CRC as avr-libc _crc_ccitt_update: reflected CCITT polynomial, initial value 0xFFFF.
+ */
+static uint16_t crc16(const uint8_t *data, int len)
+{
+	uint16_t crc = 0xFFFF;
+	while (len-- > 0) {
+		crc ^= *data++;
+		for (int i = 0; i < 8; i++) {
+			crc = (crc & 1) ? (crc >> 1) ^ 0x8408 : crc >> 1;
+		}
+	}
+	return crc;
+}
+
+static int cobs_encode(const uint8_t *src, int len, uint8_t *dst)
+{
+	uint8_t *code_ptr = dst;
+	uint8_t *out = dst + 1;
+	uint8_t code = 1;
+
+	while (len-- > 0) {
+		if (*src == 0) {
+			*code_ptr = code;
+			code_ptr = out++;
+			code = 1;
+		} else {
+			*out++ = *src;
+			if (++code == 0xFF) {
+				*code_ptr = code;
+				code_ptr = out++;
+				code = 1;
+			}
+		}
+		src++;
+	}
+	*code_ptr = code;
+	*out++ = TLM_FRAME_DELIM;
+	return out - dst;
+}
+
+int cobs_decode(const uint8_t *src, int len, uint8_t *dst)
+{
+	const uint8_t *end = src + len;
+	uint8_t *out = dst;
+
+	while (src < end) {
+		uint8_t code = *src++;
+		if (code == 0) {
+			return -1;
+		}
+		for (uint8_t i = 1; i < code; i++) {
+			if (src >= end) {
+				return -1;
+			}
+			*out++ = *src++;
+		}
+		if (code != 0xFF && src < end) {
+			*out++ = 0;
+		}
+	}
+	return out - dst;
+}
+
+static void print_packet(const uint8_t *pkt, int len)
+{
+	if (len < 1 + TLM_CRC_SIZE || crc16(pkt, len) != 0) {
+		printf("bad frame (%d bytes)\n", len);
+		return;
+	}
+	len -= TLM_CRC_SIZE;
+
+	switch (pkt[0]) {
+		case TLM_SAMPLE:
+			if (len != TLM_SAMPLE_SIZE) {
+				printf("bad sample length %d\n", len);
+				break;
+			}
+			{
+				uint32_t time = pkt[1] | (pkt[2] << 8) | ((uint32_t) pkt[3] << 16) | ((uint32_t) pkt[4] << 24);
+				int16_t temp = (int16_t) (pkt[6] | (pkt[7] << 8));
+				printf("%lu ms sensor %u %.4f C%s%s%s\n", (unsigned long) time, pkt[5], temp / 16.0,
+					(pkt[8] & TLM_STATUS_SERVICE) ? " service" : "",
+					(pkt[8] & TLM_STATUS_LIGHTS) ? " lights" : "",
+					(pkt[8] & TLM_STATUS_FANS) ? " fans" : "");
+			}
+			break;
+
+		case TLM_BATCH:
+			if (len != TLM_BATCH_SIZE) {
+				printf("bad batch length %d\n", len);
+				break;
+			}
+			{
+				uint32_t time = pkt[1] | (pkt[2] << 8) | ((uint32_t) pkt[3] << 16) | ((uint32_t) pkt[4] << 24);
+				int16_t min = (int16_t) (pkt[7] | (pkt[8] << 8));
+				int16_t max = (int16_t) (pkt[9] | (pkt[10] << 8));
+				int16_t mean = (int16_t) (pkt[11] | (pkt[12] << 8));
+				printf("%lu ms sensor %u %u samples mean %.4f C min %.4f max %.4f%s%s%s\n", (unsigned long) time,
+					pkt[5], pkt[6], mean / 16.0, min / 16.0, max / 16.0,
+					(pkt[13] & TLM_STATUS_SERVICE) ? " service" : "",
+					(pkt[13] & TLM_STATUS_LIGHTS) ? " lights" : "",
+					(pkt[13] & TLM_STATUS_FANS) ? " fans" : "");
+			}
+			break;
+
+		case TLM_HISTORY:
+			if (len < 3 || pkt[2] > TLM_HISTORY_CHUNK || len != 3 + pkt[2] * TLM_HISTORY_SAMPLE_SIZE) {
+				printf("bad history length %d\n", len);
+				break;
+			}
+			printf("history: %u samples%s%s\n", pkt[2],
+				(pkt[1] & TLM_HISTORY_GAP) ? ", some overwritten before these" : "",
+				(pkt[1] & TLM_HISTORY_MORE) ? ", more follow" : "");
+			for (int i = 0; i < pkt[2]; i++) {
+				const uint8_t *s = pkt + 3 + i * TLM_HISTORY_SAMPLE_SIZE;
+				uint32_t time = s[0] | (s[1] << 8) | ((uint32_t) s[2] << 16) | ((uint32_t) s[3] << 24);
+				int16_t temp = (int16_t) (s[4] | (s[5] << 8));
+				printf("  %lu ms %.4f C\n", (unsigned long) time, temp / 16.0);
+			}
+			break;
+
+		case TLM_TEXT:
+			printf("text: ");
+			for (int i = 1; i < len; i++) {
+				if (pkt[i] != 0) {
+					putchar(pkt[i]);
+				}
+			}
+			putchar('\n');
+			break;
+
+		default:
+			printf("unknown packet type 0x%02X\n", pkt[0]);
+			break;
+	}
+}
+
+static int encode_command(const char *command)
+{
+	uint8_t pkt[FRAME_MAX];
+	uint8_t frame[FRAME_MAX + 4];
+	int len = strlen(command);
+
+	if (len > FRAME_MAX - 1 - TLM_CRC_SIZE) {
+		fprintf(stderr, "command too long\n");
+		return 1;
+	}
+	pkt[0] = TLM_COMMAND;
+	memcpy(pkt + 1, command, len);
+	uint16_t crc = crc16(pkt, len + 1);
+	pkt[len + 1] = crc & 0xFF;
+	pkt[len + 2] = crc >> 8;
+	fwrite(frame, 1, cobs_encode(pkt, len + 1 + TLM_CRC_SIZE, frame), stdout);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	uint8_t frame[FRAME_MAX];
+	uint8_t pkt[FRAME_MAX];
+	int len = 0;
+	int c;
+
+	if (argc == 3 && !strcmp(argv[1], "-c")) {
+		return encode_command(argv[2]);
+	}
+	if (argc != 1) {
+		fprintf(stderr, "usage: %s [-c COMMAND]\n", argv[0]);
+		return 2;
+	}
+
+	while ((c = getchar()) != EOF) {
+		if (c != TLM_FRAME_DELIM) {
+			if (len < FRAME_MAX) {
+				frame[len] = c;
+			}
+			len++;
+			continue;
+		}
+		if (len > FRAME_MAX) {
+			printf("oversized frame (%d bytes)\n", len);
+		} else if (len > 0) {
+			int n = cobs_decode(frame, len, pkt);
+			if (n < 0) {
+				printf("bad COBS frame\n");
+			} else {
+				print_packet(pkt, n);
+			}
+		}
+		fflush(stdout);
+		len = 0;
+	}
+	return 0;
+}
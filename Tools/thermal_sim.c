@@ -0,0 +1,240 @@
+/*
+ * thermal_sim.c
+ *	Host-side closed-loop simulation of one zone. The firmware's own control
+ *  law (System/System/Control.c with Pid.c and Filter.c) drives a lumped
+ *  thermal model of the box through this file's Pwm.h functions, faster than
+ *  real time, and the run is summarized as settling time, overshoot, heater
+ *  switching count and host CPU time per control step. The model is
+ *  deterministic (noise comes from a seeded generator), so runs repeat.
+ *
+ *  Plant: heat capacity C, lamp power P while the lamps are on (switched over
+ *  the firmware's PWM_HEATER_WINDOW_MS window by pwm_heater_window), loss (G0 + Gfan * fan duty) * (T - ambient),
+ *  and a sensor that lags the air with time constant tau and reads in
+ *  1/16 degree steps truncated to the configured resolution.
+ *
+ *  Build:  cc -O2 -I../System/System -o thermal_sim thermal_sim.c
+ *              ../System/System/Control.c ../System/System/Pid.c ../System/System/Filter.c -lm
+ *  Use:    thermal_sim -t 45 -d 3600
+ *          thermal_sim -t 45 -v > trace.csv
+ *
+ * Created: 10/19/2026
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "Control.h"
+#include "Pwm.h"
+
+#define STEP_MS			10		// integration step
+#define OVER_TEMP		80.0	// firmware default limit, degrees Celsius
+
+/*
+ * The simulated outputs behind the Pwm.h interface
+ */
+static uint16_t heater_duty[PWM_CHANNELS];
+static uint16_t fan_duty[PWM_CHANNELS];
+
+void pwm_init(void)
+{
+}
+
+static uint8_t heater_on_ticks[PWM_CHANNELS];
+static int16_t heater_carry[PWM_CHANNELS];
+
+void pwm_set_heater(uint8_t zone, uint16_t duty)
+{
+	heater_duty[zone] = duty > PWM_MAX ? PWM_MAX : duty;
+	if (duty == 0) {
+		heater_on_ticks[zone] = 0;	//as in Pwm.c: off at once
+	}
+}
+
+void pwm_set_fan(uint8_t zone, uint16_t duty)
+{
+	fan_duty[zone] = duty > PWM_MAX ? PWM_MAX : duty;
+}
+
+uint16_t pwm_heater(uint8_t zone)
+{
+	return heater_duty[zone];
+}
+
+uint16_t pwm_fan(uint8_t zone)
+{
+	return fan_duty[zone];
+}
+
+/*
+ * Model and run parameters; the defaults approximate the lamp box
+ */
+typedef struct {
+	double target;			// degrees Celsius
+	double ambient;
+	double capacity;		// J/K
+	double power;			// W, lamps fully on
+	double loss;			// W/K with the fans off
+	double fan_loss;		// additional W/K at full fan
+	double tau;				// sensor time constant, s
+	double band;			// settled when within +-band of the target
+	int noise;				// peak reading noise, 1/16 degree steps
+	int resolution;			// sensor bits, 9-12
+	int sample_ms;			// sample period
+	long duration_s;
+	int16_t kp, ki, kd;
+	uint8_t median;
+	uint16_t alpha;
+	unsigned seed;
+	int verbose;
+} SIM;
+
+static unsigned long rng_state;
+
+static int noise(int peak)
+{
+	if (peak <= 0) {
+		return 0;
+	}
+	rng_state = rng_state * 1103515245UL + 12345UL;
+	return (int) ((rng_state >> 16) % (2 * peak + 1)) - peak;
+}
+
+static double now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int run(const SIM *sim)
+{
+	ZONE zone;
+	double air = sim->ambient;
+	double sensor = sim->ambient;
+	double peak = sim->ambient;
+	double settled_at = -1;			// last time the air left the band
+	double control_ns = 0;
+	long steps = 0;
+	long switches = 0;
+	int heater_on = 0;
+	int shut = 0;
+	int16_t target = (int16_t) lround(sim->target * 16);
+	int16_t over_temp = (int16_t) lround(OVER_TEMP * 16);
+
+	rng_state = sim->seed;
+	pid_init(&zone.pid, sim->kp, sim->ki, sim->kd);
+	filter_init(&zone.filter, sim->median, sim->alpha);
+	pwm_set_heater(0, 0);
+	pwm_set_fan(0, PWM_FAN_DEFAULT);
+	if (sim->verbose) {
+		printf("time_s,air_c,reading_c,heater,fan\n");
+	}
+
+	for (long t = 0; t < sim->duration_s * 1000; t += STEP_MS) {
+		if (t % sim->sample_ms == 0) {
+			int reading = (int) floor(sensor * 16) + noise(sim->noise);
+			reading &= ~((1 << (12 - sim->resolution)) - 1);
+			int16_t temp, output;
+
+			double start = now_ns();
+			uint8_t result = control_update(&zone, 0, shut ? CONTROL_OFF : CONTROL_RUN, reading, target, over_temp, &temp, &output);
+			control_ns += now_ns() - start;
+			steps++;
+			if (result == CONTROL_OVER_TEMP) {
+				pwm_set_heater(0, 0);
+				pwm_set_fan(0, 0);
+				shut = 1;
+				printf("over-temperature shutdown at %.1f s\n", t / 1000.0);
+			}
+			if (sim->verbose) {
+				printf("%.2f,%.3f,%.4f,%u,%u\n", t / 1000.0, air, reading / 16.0, heater_duty[0], fan_duty[0]);
+			}
+		}
+
+		//the lamps are on for the first on ticks of each window, as the TIMER1 ISR switches them
+		long tick = t / PWM_HEATER_TICK_MS % PWM_HEATER_TICKS;
+		if (t % PWM_HEATER_TICK_MS == 0 && tick == 0) {
+			heater_on_ticks[0] = pwm_heater_window(heater_duty[0], &heater_carry[0]);
+		}
+		int on = tick < heater_on_ticks[0];
+		if (on != heater_on) {
+			switches++;
+			heater_on = on;
+		}
+
+		double dt = STEP_MS / 1000.0;
+		double conductance = sim->loss + sim->fan_loss * fan_duty[0] / PWM_MAX;
+		air += dt * ((on ? sim->power : 0) - conductance * (air - sim->ambient)) / sim->capacity;
+		sensor += dt * (air - sensor) / sim->tau;
+
+		if (air > peak) {
+			peak = air;
+		}
+		if (fabs(air - sim->target) > sim->band) {
+			settled_at = -1;
+		} else if (settled_at < 0) {
+			settled_at = t / 1000.0;
+		}
+	}
+
+	if (!sim->verbose) {
+		if (settled_at >= 0) {
+			printf("settling time    %.1f s (within %.2f C)\n", settled_at, sim->band);
+		} else {
+			printf("settling time    not settled in %ld s (within %.2f C)\n", sim->duration_s, sim->band);
+		}
+		printf("overshoot        %.3f C\n", peak > sim->target ? peak - sim->target : 0.0);
+		printf("final error      %.3f C\n", air - sim->target);
+		printf("heater switches  %ld\n", switches);
+		printf("control steps    %ld, %.0f ns host CPU each\n", steps, steps ? control_ns / steps : 0.0);
+	}
+	return shut;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-t target C] [-a ambient C] [-d seconds] [-r sample ms] [-b bits]\n"
+		"          [-n noise steps] [-p Kp] [-i Ki] [-k Kd] [-m median] [-e alpha] [-s seed] [-v]\n"
+		"  gains and filter settings are in the units of the KP/KI/KD/FM/FE commands\n", name);
+}
+
+int main(int argc, char **argv)
+{
+	SIM sim = {
+		.target = 40, .ambient = 22, .capacity = 2000, .power = 100, .loss = 1.0, .fan_loss = 4.0,
+		.tau = 10, .band = 0.5, .noise = 0, .resolution = 12, .sample_ms = 1000, .duration_s = 3600,
+		.kp = PID_DEFAULT_KP, .ki = PID_DEFAULT_KI, .kd = PID_DEFAULT_KD,
+		.median = FILTER_DEFAULT_MEDIAN, .alpha = FILTER_DEFAULT_ALPHA, .seed = 1, .verbose = 0
+	};
+	int c;
+
+	while ((c = getopt(argc, argv, "t:a:d:r:b:n:p:i:k:m:e:s:v")) != -1) {
+		switch (c) {
+			case 't': sim.target = atof(optarg); break;
+			case 'a': sim.ambient = atof(optarg); break;
+			case 'd': sim.duration_s = atol(optarg); break;
+			case 'r': sim.sample_ms = atoi(optarg); break;
+			case 'b': sim.resolution = atoi(optarg); break;
+			case 'n': sim.noise = atoi(optarg); break;
+			case 'p': sim.kp = atoi(optarg); break;
+			case 'i': sim.ki = atoi(optarg); break;
+			case 'k': sim.kd = atoi(optarg); break;
+			case 'm': sim.median = atoi(optarg); break;
+			case 'e': sim.alpha = atoi(optarg); break;
+			case 's': sim.seed = strtoul(optarg, NULL, 0); break;
+			case 'v': sim.verbose = 1; break;
+			default:
+				usage(argv[0]);
+				return 2;
+		}
+	}
+	if (sim.sample_ms < STEP_MS || sim.sample_ms % STEP_MS || sim.resolution < 9 || sim.resolution > 12) {
+		fprintf(stderr, "sample period must be a multiple of %d ms, resolution 9-12 bits\n", STEP_MS);
+		return 2;
+	}
+	return run(&sim);
+}